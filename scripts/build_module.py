@@ -5,6 +5,10 @@ import glob
 import pyarrow as pa
 import numpy as np 
 arrow = pa.get_include()
+# the wheel ships versioned libraries only
+pa.create_library_symlinks()
+# headers of arrow 23+ need c++20
+std = 'c++20' if int(pa.__version__.split('.')[0]) >= 23 else 'c++17'
 
 setuptools.setup(
     name='openalpha',
@@ -13,7 +17,8 @@ setuptools.setup(
         setuptools.Extension(
             'openalpha',
             glob.glob('src/openalpha/*cc'),
-            extra_compile_args=['-std=c++17', '-Wno-deprecated-declarations'],
+            extra_compile_args=['-std=' + std, '-Wno-deprecated-declarations'],
+            define_macros=[('OPENALPHA_ARROW', None)],
             include_dirs=[
                 './src',
                 arrow,
@@ -27,6 +32,7 @@ setuptools.setup(
                 'boost_program_options',
                 'boost_filesystem',
                 'log4cxx',
+                'arrow',
                 'arrow_python',
             ],
             library_dirs=[arrow + '/..'],
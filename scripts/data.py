@@ -49,7 +49,9 @@ def main():
     arr = pd.read_parquet(os.path.join(dir, 'date.par')).values
     date = int(args[1])
     if date > 10000:
-      print(np.argwhere(arr == date)[0, 0])
+      # dates are sorted
+      di = np.searchsorted(arr[:, 0], date)
+      print(di if di < len(arr) and arr[di, 0] == date else -1)
     else:
       print(arr[date, 0])
     return
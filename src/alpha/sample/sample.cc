@@ -8,10 +8,12 @@ struct Sample : public Alpha {
     di = di - delay();
     auto close_2 = close_price.Row<double>(di - 2);
     auto close_0 = close_price.Row<double>(di);
-    // https://bisqwit.iki.fi/story/howto/openmp/
-    // #pragma omp parallel for
-    for (auto ii = 0; ii < num_instruments(); ++ii) {
-      if (!valid(di, ii)) continue;
+    // only loop over valid instruments instead of all num_instruments()
+    auto& iis = universe_list();
+    // a heavy loop can run in chunks on the engine's threads with
+    // ParallelFor(0, iis.size(), [&](int i0, int i1) { ... });
+    for (auto i = 0u; i < iis.size(); ++i) {
+      auto ii = iis[i];
       double px_2 = close_2[ii];
       double px_0 = close_0[ii];
       if (px_2 > 0 && px_0 > 0) alpha[ii] = -(px_0 - px_2);
@@ -0,0 +1,110 @@
+// Times the specialized Alpha::Calculate against the generic one checking
+// the settings at runtime, on the data of ./data.
+// usage: openalpha-bench [neutralization ...]
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "openalpha/alpha.h"
+#include "openalpha/logger.h"
+#include "openalpha/python.h"
+
+namespace openalpha {
+
+struct Reversal : public Alpha {
+  void Initialize() override { close = dr().GetData("close"); }
+  void Generate(int di, double* alpha) override {
+    di = di - delay();
+    auto close_2 = close.Row<double>(di - 2);
+    auto close_0 = close.Row<double>(di);
+    for (auto ii : universe_list()) {
+      if (close_2[ii] > 0 && close_0[ii] > 0)
+        alpha[ii] = -(close_0[ii] - close_2[ii]);
+    }
+  }
+  Table close;
+};
+
+struct CalculateBench {
+  // seconds spent in Calculate over all dates
+  static double Run(Alpha* alpha) {
+    auto num_dates = alpha->dr().GetData("date").num_rows();
+    std::chrono::duration<double> elapsed{0};
+    for (auto di = alpha->first_date(); di < num_dates - 1; ++di) {
+      alpha->GenerateDate(di);
+      auto t0 = std::chrono::steady_clock::now();
+      alpha->CalculateDate(di);
+      elapsed += std::chrono::steady_clock::now() - t0;
+    }
+    return elapsed.count();
+  }
+
+  static Alpha* Create(const std::string& name,
+                       const std::string& neutralization, int decay,
+                       double max_stock_weight, bool generic) {
+    auto alpha = new Reversal{};
+    Alpha::ParamMap params;
+    // whole market
+    auto num_instruments = alpha->dr().GetData("symbol").num_rows();
+    params["universe"] = std::to_string(num_instruments);
+    params["lookback_days"] = "2";
+    params["neutralization"] = neutralization;
+    params["decay"] = std::to_string(decay);
+    params["max_stock_weight"] = std::to_string(max_stock_weight);
+    if (generic) params["calculate"] = "generic";
+    return alpha->Alpha::Initialize(name, std::move(params));
+  }
+};
+
+}  // namespace openalpha
+
+int main(int argc, char* argv[]) {
+  using openalpha::CalculateBench;
+  std::vector<std::string> neutralizations(argv + 1, argv + argc);
+  if (neutralizations.empty()) neutralizations = {"market", "subindustry"};
+
+  auto log_config_file_path = "log.conf";
+  if (!std::ifstream(log_config_file_path).good()) {
+    std::ofstream(log_config_file_path)
+        .write(openalpha::kDefaultLogConf, strlen(openalpha::kDefaultLogConf));
+  }
+  if (!openalpha::fs::exists(openalpha::kStorePath))
+    openalpha::fs::create_directory(openalpha::kStorePath);
+  openalpha::Logger::Initialize("openalpha", log_config_file_path);
+  openalpha::InitalizePy();
+  openalpha::DataRegistry::Instance().Initialize();
+
+  // warm up the data and the caches before timing
+  CalculateBench::Run(
+      CalculateBench::Create("Bench", neutralizations[0], 1, 0, true));
+  std::cout << std::left << std::setw(32) << "neutralization" << std::setw(6)
+            << "decay" << std::setw(6) << "cap" << std::setw(12) << "generic"
+            << std::setw(12) << "specialized" << "speedup" << std::endl;
+  auto n = 0;
+  for (auto& neutralization : neutralizations) {
+    for (auto decay : {1, 4}) {
+      for (auto cap : {0., 0.1}) {
+        auto name = "Bench" + std::to_string(n++);
+        auto a = CalculateBench::Create(name + "G", neutralization, decay, cap,
+                                        true);
+        auto b = CalculateBench::Create(name + "S", neutralization, decay, cap,
+                                        false);
+        auto t0 = CalculateBench::Run(a);
+        auto t1 = CalculateBench::Run(b);
+        auto& pa = a->perf();
+        auto& pb = b->perf();
+        if (pa.Window(0, pa.size()).pnl != pb.Window(0, pb.size()).pnl) {
+          std::cerr << name << ": pnl mismatch" << std::endl;
+          return 1;
+        }
+        std::cout << std::setw(32) << neutralization << std::setw(6) << decay
+                  << std::setw(6) << cap << std::setw(12) << t0 << std::setw(12)
+                  << t1 << t0 / t1 << std::endl;
+      }
+    }
+  }
+  return 0;
+}
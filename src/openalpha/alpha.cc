@@ -1,27 +1,57 @@
 #include "alpha.h"
 
+#include <dlfcn.h>
+#include <unistd.h>
+#include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <climits>
+#include <fstream>
 #include <iomanip>
 #include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
 #include <tuple>
 
+#include "crash.h"
 #include "logger.h"
 
 namespace openalpha {
 
-static std::map<std::string, int> kUsedAlphaFileNames;
+// names of the imported alpha modules
+static std::set<std::string> kModuleNames;
+static std::mutex kModuleNamesMutex;
+
+template <typename F>
+void Alpha::Guard(F&& f) {
+  if (crash_guard_) {
+    CrashGuard::Run("Alpha: " + name_, std::forward<F>(f));
+  } else {
+    f();
+  }
+}
+
+Alpha::~Alpha() {
+  auto& memory = Memory::Instance();
+  auto n = size_t(num_dates_) * num_instruments_;
+  if (alpha_) memory.Free(alpha_[0], n * sizeof(double));
+  if (valid_) memory.Free(valid_[0], n * sizeof(bool));
+  delete[] alpha_;
+  delete[] valid_;
+}
 
 Alpha* Alpha::Initialize(const std::string& name, ParamMap&& params) {
   name_ = name;
   params_ = std::move(params);
-  num_dates_ = dr_.GetData("date").num_rows();
-  num_instruments_ = dr_.GetData("symbol").num_rows();
-  auto n = num_dates_ * num_instruments_;
-  auto raw_alpha = new double[n];  // memory leak
-  auto raw_valid = new bool[n];    // memory leak
-  for (auto i = 0; i < n; ++i) {
-    raw_alpha[i] = kNaN;
-    raw_valid[i] = false;
-  }
+  num_dates_ = dr_.num_dates();
+  num_instruments_ = dr_.num_instruments();
+  auto n = size_t(num_dates_) * num_instruments_;
+  // pages are only touched by the dates run, so they are placed on the node
+  // running the alpha, a row of alpha_ is filled with nan right before its
+  // Generate
+  auto& memory = Memory::Instance();
+  auto raw_alpha = static_cast<double*>(memory.Allocate(n * sizeof(double)));
+  auto raw_valid = static_cast<bool*>(memory.Allocate(n * sizeof(bool)));
   alpha_ = new double*[num_dates_];
   valid_ = new bool*[num_dates_];
   for (auto i = 0; i < num_dates_; ++i) {
@@ -30,10 +60,10 @@ Alpha* Alpha::Initialize(const std::string& name, ParamMap&& params) {
   }
 
   int_array_.resize(num_instruments_);
-  double_array_.resize(num_instruments_);
   pos_.resize(num_instruments_, kNaN);
+  pos_1_.resize(num_instruments_, kNaN);
   stats_.resize(num_dates_);
-  date_ = dr_.GetData("date").Data<int64_t>();
+  date_ = dr_.dates();
 
   auto param = GetParam("delay");
   if (param.size()) delay_ = std::max(0, atoi(param.c_str()));
@@ -56,23 +86,90 @@ Alpha* Alpha::Initialize(const std::string& name, ParamMap&& params) {
     neutralization_ = kNeutralizationByIndustry;
   else if (param == kNeutralizationBySubIndustry)
     neutralization_ = kNeutralizationBySubIndustry;
+  else if (boost::starts_with(param, kNeutralizationByFactors + ":"))
+    neutralization_ = param;
+  group_ = neutralization_;
+  neutralization_kind_ = kGroup;
+  if (neutralization_ == kNeutralizationByMarket) {
+    group_ = "";
+    neutralization_kind_ = kMarket;
+  }
+  if (boost::starts_with(neutralization_, kNeutralizationByFactors)) {
+    neutralization_kind_ = kFactors;
+    // alphas with the same universe share the factorization
+    auto key = std::to_string(universe_) + "," + std::to_string(delay_);
+    factors_ = FactorModel::Get(neutralization_, key);
+    group_ = factors_->group();
+  }
+  param = GetParam("cost");
+  if (param.size()) {
+    std::vector<std::string> specs;
+    boost::split(specs, param, boost::is_any_of(", "),
+                 boost::token_compress_on);
+    for (auto& spec : specs) {
+      if (spec.size()) cost_models_.push_back(CostModel::Create(spec));
+    }
+    cost_linear_.resize(num_instruments_);
+    cost_impact_.resize(num_instruments_);
+  }
+  // e.g. prune_ir_below=0.02 after 500, checked after prune_after dates
+  // by default
+  auto after = 252;
+  if (GetParam("prune_after").size()) {
+    after = std::max(0, atoi(GetParam("prune_after").c_str()));
+  }
+  for (auto kind : {"ir_below", "tvr_above", "dd_above"}) {
+    auto rule = GetParam(std::string("prune_") + kind);
+    if (rule.empty()) continue;
+    PruneRule r;
+    r.kind = kind;
+    r.threshold = atof(rule.c_str());
+    r.after = after;
+    auto pos = rule.find("after");
+    if (pos != std::string::npos) r.after = atoi(rule.c_str() + pos + 5);
+    prune_rules_.push_back(r);
+  }
   LOG_INFO("Alpha: " << name << "\ndelay=" << delay_ << "\ndecay=" << decay_
                      << "\nuniverse=" << universe_ << "\nlookback_days="
                      << lookback_days_ << "\nbook_size=" << book_size_
                      << "\nmax_stock_weight=" << max_stock_weight_
-                     << "\nneutralization=" << neutralization_);
+                     << "\nneutralization=" << neutralization_
+                     << "\ncost=" << param
+                     << "\nprune_rules=" << prune_rules_.size());
+  // settings are fixed from here, so bind the specialized Calculate
+  calculate_ = GetParam("calculate") == "generic"
+                   ? &Alpha::CalculateImpl<kAuto, kAuto, kAuto>
+                   : SelectCalculate(neutralization_kind_, decay_ > 1,
+                                     max_stock_weight_ > 0);
 
   auto path = kStorePath / name_;
-  if (!fs::exists(path)) fs::create_directory(path);
+  fs::create_directory(path);
   os_.open((path / "daily.csv").string().c_str());
-  os_ << "date,pnl,ret,tvr,long,short,sh_hld,sh_trd,nlong,nshort,ntrade\n";
+  os_ << "date,pnl,ret,tvr,long,short,sh_hld,sh_trd,nlong,nshort,ntrade,"
+         "cost,net_pnl\n";
 
-  Initialize();
+  Guard([this] { Initialize(); });
   return this;
 }
 
+PyAlpha::~PyAlpha() {
+  PyInterpreter::Lock lock(interpreter_.get());
+  // a new alpha of the same file imports it again
+  PyDict_DelItemString(PySys_GetObject("modules"), module_name_.c_str());
+  PyErr_Clear();
+  {
+    std::lock_guard<std::mutex> names_lock(kModuleNamesMutex);
+    kModuleNames.erase(module_name_);
+  }
+  // the member destructor runs without the GIL, leave None to it
+  generate_func_ = bp::object();
+}
+
 Alpha* PyAlpha::Initialize(const std::string& name, ParamMap&& params) {
   Alpha::Initialize(name, std::move(params));
+  auto group = GetParam("interpreter");
+  if (group.size()) interpreter_ = PyInterpreter::Get(group);
+  PyInterpreter::Lock lock(interpreter_.get());
 
   auto path = fs::path(GetParam("alpha"));
   bp::import("sys").attr("path").attr("insert")(0, path.parent_path().string());
@@ -81,47 +178,51 @@ Alpha* PyAlpha::Initialize(const std::string& name, ParamMap&& params) {
     LOG_FATAL("Alpha: can't open file '" + path.string() + "': No such file");
   }
 
-  auto module_name =
-      fn.substr(0, fn.length() - path.extension().string().length());
-  auto n = kUsedAlphaFileNames[fn]++;
-  if (n > 0) {
-    module_name += "__" + std::to_string(n);
-    auto fn2 = module_name + ".py";
-    auto path2 = "'" + (path.parent_path() / fn2).string() + "'";
-    if (system(("[ ! -s " + path2 + " ] && ln -s '" + fn + "' " + path2)
-                   .c_str())) {
-      // only for avoiding compile warning
+  auto stem = fn.substr(0, fn.length() - path.extension().string().length());
+  auto module_name = stem;
+  {
+    std::lock_guard<std::mutex> names_lock(kModuleNamesMutex);
+    for (auto n = 1; kModuleNames.count(module_name); ++n) {
+      module_name = stem + "__" + std::to_string(n);
     }
-    LOG_INFO("Alpha: link '" + path.string() + "' to '" + fn2 + "'");
+    kModuleNames.insert(module_name);
   }
+  module_name_ = module_name;
 
   try {
-    auto dr = bp::object(kOpenAlpha.attr("dr"));
-    auto builtins = bp::import("builtins");
-    // PyImport_ImportModuleEx with globals/locals does not work, so use
-    // builtins as a workaround
-    builtins.attr("dr") = dr;
-    builtins.attr("name") = name_;
     bp::dict py_params;
     for (auto& pair : this->params()) py_params[pair.first] = pair.second;
-    Py_INCREF(py_params.ptr());  // memory leak
-    builtins.attr("params") = py_params;
-    auto np_valid = np::from_data(
-        &valid_[0][0], np::dtype::get_builtin<bool>(),
-        bp::make_tuple(num_dates(), num_instruments()),
-        bp::make_tuple(num_instruments() * sizeof(bool), sizeof(bool)),
-        bp::object());
-    Py_INCREF(np_valid.ptr());  // memory leak
-    builtins.attr("valid") = np_valid;
-    builtins.attr("delay") = delay_;
-    builtins.attr("decay") = decay_;
-    bp::object module = bp::import(module_name.c_str());
-    PyModule_AddStringConstant(module.ptr(), "name", name_.c_str());
-    PyModule_AddObject(module.ptr(), "dr", dr.ptr());
-    PyModule_AddObject(module.ptr(), "params", py_params.ptr());
-    PyModule_AddObject(module.ptr(), "valid", np_valid.ptr());
-    PyModule_AddIntConstant(module.ptr(), "delay", delay_);
-    PyModule_AddIntConstant(module.ptr(), "decay", decay_);
+    bp::object dr;
+    bp::object py_valid;
+    if (interpreter_) {
+      // neither openalpha nor numpy can be imported in the interpreter
+      dr = interpreter_->dr();
+      py_valid = interpreter_->View(&valid_[0][0], num_dates(),
+                                    num_instruments(), "?", sizeof(bool),
+                                    true);
+    } else {
+      dr = kOpenAlpha.attr("dr");
+      py_valid = np::from_data(
+          &valid_[0][0], np::dtype::get_builtin<bool>(),
+          bp::make_tuple(num_dates(), num_instruments()),
+          bp::make_tuple(num_instruments() * sizeof(bool), sizeof(bool)),
+          bp::object());
+    }
+    // load by spec under the unique name, so the same file can be loaded
+    // by several alphas without aliasing files, with the globals of the
+    // alpha set before its code runs
+    auto util = bp::import("importlib.util");
+    auto spec = util.attr("spec_from_file_location")(module_name,
+                                                     path.string());
+    bp::object module = util.attr("module_from_spec")(spec);
+    module.attr("name") = name_;
+    module.attr("dr") = dr;
+    module.attr("params") = py_params;
+    module.attr("valid") = py_valid;
+    module.attr("delay") = delay_;
+    module.attr("decay") = decay_;
+    bp::import("sys").attr("modules")[module_name] = module;
+    spec.attr("loader").attr("exec_module")(module);
     generate_func_ = GetCallable(module, "Generate");
     if (!generate_func_) {
       LOG_FATAL("Alpha: 'generate' function not defined in '" + path.string() +
@@ -138,89 +239,247 @@ Alpha* PyAlpha::Initialize(const std::string& name, ParamMap&& params) {
   return this;
 }
 
+Alpha* Combiner::Initialize(const std::string& name, ParamMap&& params) {
+  Alpha::Initialize(name, std::move(params));
+  // valid instruments are those held by the combined alphas, can't share
+  if (factors_) factors_ = FactorModel::Get(neutralization_, name_);
+  boost::split(names_, GetParam("combine"), boost::is_any_of(", "),
+               boost::token_compress_on);
+  names_.erase(std::remove(names_.begin(), names_.end(), ""), names_.end());
+  if (names_.empty()) {
+    LOG_FATAL("Combiner: " << name << ": no alpha given in 'combine'");
+  }
+  auto param = GetParam("weights");
+  if (param.empty() || param == kWeightsEqual) {
+    weighting_ = kWeightsEqual;
+  } else if (param == kWeightsInverseVol) {
+    weighting_ = kWeightsInverseVol;
+  } else {
+    std::vector<std::string> toks;
+    boost::split(toks, param, boost::is_any_of(", "), boost::token_compress_on);
+    for (auto& tok : toks) weights_.push_back(atof(tok.c_str()));
+    if (weights_.size() != names_.size()) {
+      LOG_FATAL("Combiner: " << name << ": " << weights_.size()
+                             << " weights given for " << names_.size()
+                             << " alphas");
+    }
+    weighting_ = kWeightsStatic;
+  }
+  param = GetParam("vol_window");
+  if (param.size()) vol_window_ = std::max(2, atoi(param.c_str()));
+  weights_.resize(names_.size(), 1. / names_.size());
+  LOG_INFO("Combiner: " << name << "\ncombine=" << GetParam("combine")
+                        << "\nweights=" << weighting_
+                        << "\nvol_window=" << vol_window_);
+  return this;
+}
+
+void Combiner::Bind(const std::unordered_map<std::string, Alpha*>& alphas) {
+  alphas_.clear();
+  for (auto& name : names_) {
+    auto alpha = FindInMap(alphas, name);
+    if (!alpha) {
+      LOG_FATAL("Combiner: " << name_ << ": alpha '" << name << "' not found");
+    }
+    if (dynamic_cast<Combiner*>(alpha)) {
+      LOG_FATAL("Combiner: " << name_ << ": can not combine another combiner '"
+                             << name << "'");
+    }
+    alphas_.push_back(alpha);
+  }
+}
+
+void Combiner::UpdateWeights(int di) {
+  if (weighting_ != kWeightsInverseVol) return;
+  // inverse volatility of the last vol_window_ daily returns before di
+  for (auto k = 0u; k < alphas_.size(); ++k) {
+    auto& perf = alphas_[k]->perf_;
+    auto i1 = perf.Find(0, date(di) - 1).second;
+    auto stddev = perf.Window(std::max(0, i1 - vol_window_), i1, false).stddev;
+    weights_[k] = stddev > 0 ? 1 / stddev : 0;
+  }
+}
+
+void Combiner::Generate(int di, double* alpha) {
+  UpdateWeights(di);
+  // the universe is the union of instruments held by the combined alphas
+  auto valid = valid_[di - delay_];
+  universe_list_.clear();
+  for (auto a : alphas_) {
+    for (auto ii : a->held_) {
+      if (valid[ii]) continue;
+      valid[ii] = true;
+      alpha[ii] = 0;
+      universe_list_.push_back(ii);
+    }
+  }
+  std::sort(universe_list_.begin(), universe_list_.end());
+  for (auto k = 0u; k < alphas_.size(); ++k) {
+    auto a = alphas_[k];
+    auto& st = a->stats_[di];
+    auto gross = st.long_pos + st.short_pos;
+    if (!(gross > 0) || weights_[k] == 0) continue;
+    // each alpha's book is normalized to unit gross before blending
+    auto scale = weights_[k] / gross;
+    auto pos = a->pos_.data();
+    for (auto ii : a->held_) alpha[ii] += scale * pos[ii];
+  }
+}
+
 void Alpha::UpdateValid(int di) {
   auto values = dr_.GetData("adv60").Row<double>(di - delay_);
   for (auto i = 0u; i < int_array_.size(); ++i) int_array_[i] = i;
-  std::sort(int_array_.begin(), int_array_.end(),
-            [&values](auto i, auto j) { return values[i] < values[j]; });
+  auto n = std::min<size_t>(std::max(0, universe_), int_array_.size());
+  // O(num_instruments) selection instead of full sort, nan adv ranks last
+  std::nth_element(int_array_.begin(), int_array_.begin() + n,
+                   int_array_.end(), [&values](auto i, auto j) {
+                     auto x = values[i];
+                     auto y = values[j];
+                     return x > y || (!std::isnan(x) && std::isnan(y));
+                   });
+  universe_list_.assign(int_array_.begin(), int_array_.begin() + n);
+  std::sort(universe_list_.begin(), universe_list_.end());
   auto valid = valid_[di - delay_];
-  auto n = 0;
-  for (auto it = int_array_.rbegin(); it != int_array_.rend() && n < universe_;
-       ++it, ++n) {
-    valid[*it] = true;
+  for (auto ii : universe_list_) valid[ii] = true;
+}
+
+void Alpha::Rotate() {
+  // only touch instruments held yesterday or the day before
+  for (auto ii : held_1_) pos_1_[ii] = kNaN;
+  for (auto ii : held_) {
+    pos_1_[ii] = pos_[ii];
+    pos_[ii] = kNaN;
   }
+  held_1_.swap(held_);
+  held_.clear();
+}
+
+double Alpha::Decay(int di, int ii) const {
+  auto nsum = decay_;
+  auto sum = decay_ * alpha_[di][ii];
+  // rows before the first date run are not filled
+  auto start = lookback_days_ + delay_;
+  for (auto j = 1; j < decay_; ++j) {
+    auto di2 = di - j;
+    if (di2 < start) break;
+    auto v2 = alpha_[di2][ii];
+    if (std::isnan(v2)) continue;
+    auto n = decay_ - j;
+    nsum += n;
+    sum += v2 * n;
+  }
+  return sum / nsum;
+}
+
+void Alpha::Calculate(int di) { (this->*calculate_)(di); }
+
+Alpha::CalculateFunc Alpha::SelectCalculate(int neutralization, bool decay,
+                                            bool cap) {
+  static const CalculateFunc kFuncs[3][2][2] = {
+      {{&Alpha::CalculateImpl<kMarket, 0, 0>,
+        &Alpha::CalculateImpl<kMarket, 0, 1>},
+       {&Alpha::CalculateImpl<kMarket, 1, 0>,
+        &Alpha::CalculateImpl<kMarket, 1, 1>}},
+      {{&Alpha::CalculateImpl<kGroup, 0, 0>,
+        &Alpha::CalculateImpl<kGroup, 0, 1>},
+       {&Alpha::CalculateImpl<kGroup, 1, 0>,
+        &Alpha::CalculateImpl<kGroup, 1, 1>}},
+      {{&Alpha::CalculateImpl<kFactors, 0, 0>,
+        &Alpha::CalculateImpl<kFactors, 0, 1>},
+       {&Alpha::CalculateImpl<kFactors, 1, 0>,
+        &Alpha::CalculateImpl<kFactors, 1, 1>}},
+  };
+  return kFuncs[neutralization][decay][cap];
 }
 
-void Alpha::Calculate(int di) {
-  auto groups = neutralization_ != kNeutralizationByMarket
-                    ? dr_.GetData(neutralization_).Row<int64_t>(di - delay_)
+// kNeutralization, kDecay and kCap are kAuto for the generic version which
+// checks the settings at runtime, so the same code is used for all
+template <int kNeutralization, int kDecay, int kCap>
+void Alpha::CalculateImpl(int di) {
+  const auto neutralization =
+      kNeutralization == kAuto ? neutralization_kind_ : kNeutralization;
+  const bool decay = kDecay == kAuto ? decay_ > 1 : kDecay != 0;
+  const bool cap = kCap == kAuto ? max_stock_weight_ > 0 : kCap != 0;
+  const bool market = neutralization == kMarket;
+  auto groups = !market && group_.size()
+                    ? dr_.GetData(group_).Row<int64_t>(di - delay_)
                     : nullptr;
   auto alpha = alpha_[di];
   auto valid = valid_[di - delay_];
   std::map<int64_t, std::vector<int>> grouped;
-  auto pos_1 = double_array_;
   auto close = dr_.GetData("close");
   auto close0 = close.Row<double>(di);
   auto close1 = close.Row<double>(di + 1);
-  for (auto ii = 0; ii < num_instruments_; ++ii) {
-    pos_1[ii] = pos_[ii];
-    pos_[ii] = kNaN;
+  Rotate();
+  for (auto ii : universe_list_) {
     auto v = alpha[ii];
     if (!valid[ii]) continue;
-    if (std::isnan(alpha[ii])) continue;
-    auto ig = groups ? groups[ii] : 0;
-    if (ig < 0) continue;
-    if (decay_ > 1) {
-      auto nsum = decay_;
-      auto sum = decay_ * v;
-      for (auto j = 1; j < decay_; ++j) {
-        auto di2 = di - j;
-        if (di2 < 0) continue;
-        auto v2 = alpha_[di2][ii];
-        if (std::isnan(v2)) continue;
-        auto n = decay_ - j;
-        nsum += n;
-        sum += v2 * n;
-      }
-      v = sum / nsum;
+    if (std::isnan(v)) continue;
+    int64_t ig = 0;
+    if (!market) {
+      ig = groups ? groups[ii] : 0;
+      if (ig < 0) continue;
     }
+    if (decay) v = Decay(di, ii);
     pos_[ii] = v;
-    grouped[ig].push_back(ii);
+    held_.push_back(ii);
+    if (!market) grouped[ig].push_back(ii);
   }
 
   double sum;
   auto max_try = 10;
   for (auto itry = 0; itry <= max_try; ++itry) {
     sum = 0;
-    for (auto& pair : grouped) {
-      if (pair.second.size() == 1) {
-        auto ii = pair.second[0];
-        pos_[ii] = kNaN;
-        continue;
+    if (neutralization == kFactors) {
+      sum = factors_->Neutralize(di - delay_, valid, &grouped, pos_.data());
+    } else if (market) {
+      // held_ is the only group, no nan in it after this
+      if (held_.size() > 1) {
+        auto sum2 = 0.;
+        for (auto ii : held_) sum2 += pos_[ii];
+        auto avg = sum2 / held_.size();
+        for (auto ii : held_) {
+          pos_[ii] -= avg;
+          sum += std::abs(pos_[ii]);
+        }
       }
-      auto sum2 = 0.;
-      for (auto ii : pair.second) sum2 += pos_[ii];
-      auto avg = sum2 / pair.second.size();
-      for (auto ii : pair.second) {
-        pos_[ii] -= avg;
-        sum += std::abs(pos_[ii]);
+    } else {
+      for (auto& pair : grouped) {
+        if (pair.second.size() == 1) {
+          auto ii = pair.second[0];
+          pos_[ii] = kNaN;
+          continue;
+        }
+        auto sum2 = 0.;
+        for (auto ii : pair.second) sum2 += pos_[ii];
+        auto avg = sum2 / pair.second.size();
+        for (auto ii : pair.second) {
+          pos_[ii] -= avg;
+          sum += std::abs(pos_[ii]);
+        }
       }
     }
-    if (sum == 0) return;
-    if (max_stock_weight_ <= 0 || itry == max_try) break;
+    if (sum == 0) {
+      for (auto ii : held_) pos_[ii] = kNaN;
+      held_.clear();
+      return;
+    }
+    if (!cap || itry == max_try) break;
     auto max_value = max_stock_weight_ * sum;
     auto threshold = max_value * 1.01;
     auto breach = false;
-    for (auto v : pos_) {
-      if (std::isnan(v)) continue;
+    for (auto ii : held_) {
+      auto v = pos_[ii];
+      if (!market && std::isnan(v)) continue;
       if (std::abs(v) > threshold) {
         breach = true;
         break;
       }
     }
     if (!breach) break;
-    for (auto& v : pos_) {
-      if (std::isnan(v)) continue;
+    for (auto ii : held_) {
+      auto& v = pos_[ii];
+      if (!market && std::isnan(v)) continue;
       if (std::abs(v) > max_value) v = max_value * (v > 0 ? 1 : -1);
     }
   }
@@ -231,9 +490,11 @@ void Alpha::Calculate(int di) {
   auto sh_hld = 0.;
   auto nlong = 0.;
   auto nshort = 0.;
-  for (auto ii = 0; ii < num_instruments_; ++ii) {
+  auto n = 0u;
+  for (auto ii : held_) {
     auto& v = pos_[ii];
-    if (std::isnan(v)) continue;
+    if (!market && std::isnan(v)) continue;
+    held_[n++] = ii;
     v = std::round(v / sum * book_size_);
     auto px0 = close0[ii];
     auto px1 = close1[ii];
@@ -248,22 +509,48 @@ void Alpha::Calculate(int di) {
     }
     if (px0 > 0) sh_hld += std::abs(v) / px0;
   }
+  held_.resize(n);
+  Record(di, close0, pnl, long_pos, short_pos, sh_hld, nlong, nshort);
+}
+
+void Alpha::Record(int di, const double* close0, double pnl, double long_pos,
+                   double short_pos, double sh_hld, double nlong,
+                   double nshort) {
   // In WebSim, return = annualized PnL / half of book size.
   auto ret = pnl / (book_size_ / 2);
 
+  // traded instruments are those held today or yesterday
+  traded_ = held_;
+  for (auto ii : held_1_) {
+    if (std::isnan(pos_[ii])) traded_.push_back(ii);
+  }
+  auto has_cost = !cost_models_.empty();
+  if (has_cost) {
+    for (auto ii : traded_) {
+      cost_linear_[ii] = 0;
+      cost_impact_[ii] = 0;
+    }
+    for (auto& model : cost_models_) {
+      model->Update(di, traded_, cost_linear_.data(), cost_impact_.data());
+    }
+  }
   auto tvr = 0.;
   auto ntrade = 0;
   auto sh_trd = 0.;
-  for (auto ii = 0; ii < num_instruments_; ++ii) {
+  auto cost = 0.;
+  for (auto ii : traded_) {
     auto v = pos_[ii];
     if (std::isnan(v)) v = 0;
-    auto v_1 = pos_1[ii];
+    auto v_1 = pos_1_[ii];
     if (std::isnan(v_1)) v_1 = 0;
     auto x = std::abs(v - v_1);
     tvr += x;
     if (x != 0) ntrade++;
     auto px = close0[ii];
     if (px > 0) sh_trd += x / px;
+    if (has_cost) {
+      cost += x * (cost_linear_[ii] + cost_impact_[ii] * std::sqrt(x));
+    }
   }
   tvr /= book_size_ * 2;
   auto& st = stats_[di];
@@ -275,104 +562,173 @@ void Alpha::Calculate(int di) {
   st.nlong = nlong;
   st.nshort = nshort;
   st.pnl = pnl;
+  st.cost = cost;
+  perf_.Add(st.date, ret, pnl, tvr, long_pos, short_pos, nlong, nshort, cost,
+            (pnl - cost) / (book_size_ / 2));
   os_ << std::setprecision(15) << st.date << ',' << pnl << ',' << ret << ','
       << tvr << ',' << long_pos << ',' << short_pos << ',' << round(sh_hld)
       << ',' << round(sh_trd) << ',' << nlong << ',' << nshort << ',' << ntrade
-      << '\n';
+      << ',' << cost << ',' << (pnl - cost) << '\n';
 }
 
-static void Report(const std::string& year,
-                   const std::vector<Alpha::Stats>& sts, std::ostream& os) {
-  if (sts.empty()) return;
-  auto dd_reset = true;
-  auto dd_sum = 0.;
-  auto dd_start = 0;
-  auto dd_sum_max = 0.;
-  auto dd_start_max = 0.;
-  auto dd_end_max = 0;
-  auto tvr = 0.;
-  auto ret_sum = 0.;
-  auto ret_sum2 = 0.;
-  auto long_pos = 0.;
-  auto short_pos = 0.;
-  auto nlong = 0l;
-  auto nshort = 0l;
-  auto pnl = 0.;
-  for (auto& t : sts) {
-    auto ret = t.ret;
-    ret_sum2 += ret * ret;
-    ret_sum += ret;
-    auto date = t.date;
-    if (dd_reset) {
-      dd_start = date;
-      dd_reset = false;
+bool Alpha::Prune(int di) {
+  auto n = perf_.size();
+  if (prune_rules_.empty() || !n || pruned_.size()) return false;
+  auto perf = perf_.Window(0, n, false);
+  for (auto& rule : prune_rules_) {
+    if (n < rule.after) continue;
+    auto value = perf.ir;
+    if (rule.kind == "tvr_above") {
+      value = perf.tvr;
+    } else if (rule.kind == "dd_above") {
+      // current drawdown in return, i.e. over half of the book size
+      value = -perf_.drawdown(n - 1) / (book_size_ / 2);
     }
-    dd_sum += t.pnl;
-    if (dd_sum >= 0) {
-      dd_sum = 0;
-      dd_start = date;
-      dd_reset = true;
-    }
-    if (dd_sum < dd_sum_max) {
-      dd_sum_max = dd_sum;
-      dd_start_max = dd_start;
-      dd_end_max = date;
-    }
-    tvr += t.tvr;
-    long_pos += t.long_pos;
-    short_pos += t.short_pos;
-    nlong += t.nlong;
-    nshort += t.nshort;
-    pnl += t.pnl;
-  }
-
-  auto stddev = 0.;
-  auto ir = 0.;
-  auto d = sts.size();
-  auto avg = ret_sum / d;
-  if (d > 1) stddev = sqrt(1. / (d - 1) * (ret_sum2 - ret_sum * ret_sum / d));
-  if (stddev > 0) ir = avg / stddev;
-  tvr /= d;
-  auto sharp = ir * sqrt(252);
-  auto ret = ret_sum / d * 252;
-  auto fitness = sharp * sqrt(std::abs(ret) / tvr);
-  os << year << ',' << pnl << ',' << (ret_sum / d) << ',' << ir << ','
-     << dd_sum_max << ',' << dd_start_max << ',' << dd_end_max << ',' << tvr
-     << ',' << (long_pos / d) << ',' << (short_pos / d) << ',' << (nlong / d)
-     << ',' << (nshort / d) << ',' << fitness << '\n';
+    auto below = rule.kind == "ir_below";
+    if (!(below ? value < rule.threshold : value > rule.threshold)) continue;
+    pruned_ = rule.kind;
+    pruned_date_ = date(di);
+    LOG_INFO("Alpha: " << name_ << ": pruned at " << pruned_date_ << " after "
+                       << n << " dates, " << rule.kind << " "
+                       << rule.threshold << ": " << value);
+    Release();
+    return true;
+  }
+  return false;
+}
+
+void Alpha::Quarantine(const std::string& error, int date) {
+  pruned_ = "error";
+  error_ = error;
+  pruned_date_ = date;
+  LOG_ERROR("Alpha: " << name_ << ": quarantined at " << date);
+  Release();
 }
 
-void Alpha::Report() {
-  std::vector<Stats> sts;
-  std::map<int, std::vector<Stats>> yearly;
-  for (auto di = 0; di < num_dates_; ++di) {
-    auto& st = stats_[di];
-    if (std::isnan(st.ret)) continue;
-    auto d = date(di);
-    sts.push_back(st);
-    yearly[d / 10000].push_back(st);
+void Alpha::GenerateDate(int di) {
+  UpdateValid(di);
+  if (signal_cached_) return;
+  std::fill_n(alpha_[di], num_instruments_, kNaN);
+  Generate(di, alpha_[di]);
+}
+
+void Alpha::Release() {
+  // valid_ stays, a python alpha's module holds it as numpy array
+  auto n = size_t(num_dates_) * num_instruments_;
+  if (alpha_) Memory::Instance().Free(alpha_[0], n * sizeof(double));
+  delete[] alpha_;
+  alpha_ = nullptr;
+  for (auto v : {&pos_, &pos_1_, &cost_linear_, &cost_impact_}) {
+    std::vector<double>().swap(*v);
   }
+  for (auto v : {&held_, &held_1_, &traded_, &universe_list_}) {
+    std::vector<int>().swap(*v);
+  }
+  std::vector<int64_t>().swap(int_array_);
+  cost_models_.clear();
+}
+
+void Alpha::Report(const SharpeTrials& trials) {
   os_.close();
+  // rows of a complete run only
+  if (signal_key_ && !signal_cached_ && pruned_.empty()) WriteSignal();
   auto path = kStorePath / name();
   LOG_INFO("Alpha: dump daily results: " << (path / "daily.csv"));
+  std::map<int, std::pair<int, int>> yearly;
+  std::map<int, std::pair<int, int>> monthly;
+  for (auto i = 0; i < perf_.size(); ++i) {
+    auto d = perf_.date(i);
+    for (auto* m : {&yearly[d / 10000], &monthly[d / 100]}) {
+      if (m->second == 0) m->first = i;
+      m->second = i + 1;
+    }
+  }
+  std::vector<std::string> sections;
+  boost::split(sections, GetParam("report"), boost::is_any_of(", "),
+               boost::token_compress_on);
+  auto num_resamples = 1000;
+  if (GetParam("bootstrap").size()) {
+    num_resamples = std::max(0, atoi(GetParam("bootstrap").c_str()));
+  }
+  auto block = atof(GetParam("bootstrap_block").c_str());
+  std::ostringstream os;
+  // row of [i0, i1), with the significance columns if bootstrap is on
+  auto write = [&](const std::string& label, int i0, int i1,
+                   const Significance* sig = nullptr) {
+    PerfSeries::Write(label, perf_.Window(i0, i1), os);
+    if (num_resamples) {
+      if (sig) {
+        sig->Write(os);
+      } else {
+        Significance::Test(perf_, i0, i1, num_resamples, block, Hash(name_))
+            .Write(os);
+      }
+    }
+    os << '\n';
+  };
   path = path / "perf.csv";
-  os_.open(path.string().c_str());
-  os_ << "date,pnl,ret,ir,dd,dd_start,dd_end,tvr,long,short,"
-         "nlong,nshort,fitness\n";
-  for (auto& pair : yearly)
-    openalpha::Report(std::to_string(pair.first), pair.second, os_);
+  os << std::setprecision(15) << PerfSeries::kHeader
+     << (num_resamples ? Significance::kHeader : "") << '\n';
+  for (auto& pair : yearly) {
+    write(std::to_string(pair.first), pair.second.first, pair.second.second);
+  }
+  // the whole range is deflated by the number of alphas of the run
+  auto sig = Significance::Test(perf_, 0, perf_.size(), num_resamples, block,
+                                Hash(name_));
+  sig.Deflate(trials);
   std::string range;
   if (!yearly.empty()) {
     range = std::to_string(yearly.begin()->first) + "-" +
             std::to_string(yearly.rbegin()->first);
+    write(range, 0, perf_.size(), &sig);
   }
-  openalpha::Report(range, sts, os_);
-  os_.close();
+  if (pruned_.size()) {
+    write("pruned:" + pruned_ + ":" + std::to_string(pruned_date_), 0,
+          perf_.size(), &sig);
+  }
+  for (auto& section : sections) {
+    std::vector<std::string> toks;
+    boost::split(toks, section, boost::is_any_of(":"));
+    if (toks[0] == "monthly") {
+      for (auto& pair : monthly) {
+        write(std::to_string(pair.first), pair.second.first,
+              pair.second.second);
+      }
+    } else if (toks[0] == "split" && toks.size() > 1) {
+      // in-sample / out-of-sample rows split at the given date
+      auto date = atoi(toks[1].c_str());
+      for (auto& w : {perf_.Find(0, date - 1), perf_.Find(date, INT_MAX)}) {
+        if (w.first == w.second) continue;
+        write(std::to_string(perf_.date(w.first)) + "-" +
+                  std::to_string(perf_.date(w.second - 1)),
+              w.first, w.second);
+      }
+    } else if (toks[0] == "rolling" && toks.size() > 1) {
+      auto n = atoi(toks[1].c_str());
+      auto path2 = kStorePath / name() / ("rolling_" + toks[1] + ".csv");
+      std::ofstream os(path2.string().c_str());
+      // no drawdown, which is not answered from prefix sums
+      os << std::setprecision(15)
+         << "date,pnl,ret,ir,tvr,fitness,net_pnl,net_ir,net_fitness\n";
+      for (auto& perf : perf_.Rolling(n)) {
+        os << perf.date1 << ',' << perf.pnl << ',' << perf.ret << ','
+           << perf.ir << ',' << perf.tvr << ',' << perf.fitness << ','
+           << perf.net_pnl << ',' << perf.net_ir << ',' << perf.net_fitness
+           << '\n';
+      }
+      LOG_INFO("Alpha: dump rolling performance: " << path2);
+    } else if (section.size()) {
+      LOG_ERROR("Alpha: unknown report section '" << section << "'");
+    }
+  }
+  report_ = os.str();
+  std::ofstream(path.string().c_str()) << report_;
   range = "";
-  if (!sts.empty()) {
-    range = std::to_string(sts.begin()->date) + "-" +
-            std::to_string(sts.rbegin()->date);
+  if (perf_.size()) {
+    range = std::to_string(perf_.date(0)) + "-" +
+            std::to_string(perf_.date(perf_.size() - 1));
   }
+  GilLock lock;
   try {
     LOG_INFO(
         "Alpha: dump performance report: "
@@ -388,11 +744,18 @@ void Alpha::Report() {
 }
 
 void PyAlpha::Generate(int di, double* alpha) {
-  auto py_alpha =
-      np::from_data(alpha, np::dtype::get_builtin<decltype(alpha[0])>(),
-                    bp::make_tuple(num_instruments()),
-                    bp::make_tuple(sizeof(alpha[0])), bp::object());
+  PyInterpreter::Lock lock(interpreter_.get());
   try {
+    bp::object py_alpha;
+    if (interpreter_) {
+      py_alpha = interpreter_->View(alpha, -1, num_instruments(), "d",
+                                    sizeof(alpha[0]), false);
+    } else {
+      py_alpha =
+          np::from_data(alpha, np::dtype::get_builtin<decltype(alpha[0])>(),
+                        bp::make_tuple(num_instruments()),
+                        bp::make_tuple(sizeof(alpha[0])), bp::object());
+    }
     generate_func_(di, py_alpha);
   } catch (const bp::error_already_set& err) {
     PrintPyError("Alpha: failed to run '" + GetParam("alpha") + "': ", true,
@@ -400,18 +763,355 @@ void PyAlpha::Generate(int di, double* alpha) {
   }
 }
 
+// dlopen of a path returns the library already loaded, so a changed .so is
+// copied to a new path before being loaded again
+static std::shared_ptr<void> OpenLibrary(const std::string& path) {
+  struct Library {
+    std::time_t mtime = 0;
+    std::shared_ptr<void> handle;
+  };
+  static std::mutex kMutex;
+  static std::map<std::string, Library> kLibraries;
+  static int kNumReloads = 0;
+  std::lock_guard<std::mutex> lock(kMutex);
+  if (!fs::exists(path)) {
+    LOG_FATAL("Alpha: can't open file '" << path << "': No such file");
+  }
+  auto mtime = fs::last_write_time(path);
+  auto& library = kLibraries[path];
+  if (library.handle && library.mtime == mtime) return library.handle;
+  auto load_path = path;
+  if (library.handle) {
+    load_path = (fs::temp_directory_path() /
+                 ("openalpha-" + std::to_string(getpid()) + "-" +
+                  std::to_string(++kNumReloads) + ".so"))
+                    .string();
+    fs::copy_file(path, load_path);
+    LOG_INFO("Alpha: reload '" << path << "'");
+  }
+  auto handle = dlopen(load_path.c_str(), RTLD_NOW);
+  if (load_path != path) fs::remove(load_path);
+  if (!handle) {
+    LOG_FATAL("Alpha: failed to load '" << path + "': " << dlerror());
+  }
+  library.mtime = mtime;
+  // closed once the alphas created from it are deleted
+  library.handle = std::shared_ptr<void>(handle, dlclose);
+  return library.handle;
+}
+
+// deletes the alpha if its initialization fails
+template <typename T>
+static Alpha* Initialize(T* alpha, const std::string& name,
+                         Alpha::ParamMap&& params) {
+  std::unique_ptr<T> guard(alpha);
+  guard->Initialize(name, std::move(params));
+  return guard.release();
+}
+
+Alpha* AlphaRegistry::Create(const std::string& name,
+                             Alpha::ParamMap&& params) {
+  auto path = params["alpha"];
+  if (!params["combine"].empty()) {
+    return Initialize(new Combiner, name, std::move(params));
+  }
+  if (path.empty()) return nullptr;
+  if (boost::algorithm::ends_with(path, ".py")) {
+    return Initialize(new PyAlpha, name, std::move(params));
+  }
+  if (!boost::algorithm::ends_with(path, ".so")) {
+    LOG_FATAL("Alpha: invalid path file '"
+              << path << "', expected '.py' or '.so' file")
+  }
+  auto library = OpenLibrary(path);
+  typedef Alpha* (*CFunc)();
+  auto create_func = (CFunc)dlsym(library.get(), "create");
+  if (!create_func) {
+    LOG_FATAL("Alpha: failed to load '" << path + "': " << dlerror());
+  }
+  auto alpha = dynamic_cast<Alpha*>(create_func());
+  if (!alpha) {
+    LOG_FATAL("Alpha: failed to load '"
+              << path + "', create() does not return Alpha object");
+  }
+  if (alpha->GetVersion() != kApiVersion) {
+    LOG_FATAL("Alpha: failed to load '" << path + "': version mismatch, "
+                                        << "got " << alpha->GetVersion()
+                                        << ", expect " << kApiVersion);
+  }
+  alpha->crash_guard_ = params["crash_guard"] == "true";
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    libraries_.push_back(library);
+  }
+  DataRegistry::LibraryScope scope(library);
+  return Initialize(alpha, name, std::move(params));
+}
+
+// registry of the job on the thread, several may run at once in the daemon
+static thread_local AlphaRegistry* kCurrentRegistry = nullptr;
+
+AlphaRegistry& AlphaRegistry::Current() {
+  return kCurrentRegistry ? *kCurrentRegistry : Instance();
+}
+
+AlphaRegistry::Scope::Scope(AlphaRegistry* registry)
+    : prev_(kCurrentRegistry) {
+  kCurrentRegistry = registry;
+}
+
+AlphaRegistry::Scope::~Scope() { kCurrentRegistry = prev_; }
+
+void AlphaRegistry::Load(const boost::property_tree::ptree& config) {
+  Scope scope(this);
+  std::vector<std::pair<std::string, Alpha::ParamMap>> sections;
+  for (auto& section : config) {
+    if (!section.second.size()) continue;
+    Alpha::ParamMap params;
+    for (auto& item : section.second) {
+      auto name = item.first;
+      boost::to_lower(name);
+      params[name] = item.second.data();
+    }
+    sections.emplace_back(section.first, std::move(params));
+  }
+  // python alphas are imported one by one under the GIL, the others are
+  // initialized in parallel
+  std::vector<Alpha*> alphas(sections.size());
+  std::vector<int> others;
+  for (auto i = 0u; i < sections.size(); ++i) {
+    auto& params = sections[i].second;
+    if (params["combine"].empty() &&
+        boost::algorithm::ends_with(params["alpha"], ".py")) {
+      try {
+        FaultScope scope;
+        alphas[i] = Create(sections[i].first, std::move(params));
+      } catch (const FatalError& err) {
+        errors_.emplace_back(sections[i].first, err.what());
+      }
+    } else {
+      others.push_back(i);
+    }
+  }
+  TaskPool::Instance().ParallelFor(
+      0, others.size(),
+      [&](int i0, int i1) {
+        for (auto i = i0; i < i1; ++i) {
+          auto& section = sections[others[i]];
+          try {
+            FaultScope scope;
+            alphas[others[i]] =
+                Create(section.first, std::move(section.second));
+          } catch (const FatalError& err) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            errors_.emplace_back(section.first, err.what());
+          }
+        }
+      },
+      1);
+  // the data version of the signal keys is computed once, after the alphas
+  // registered their derived fields
+  auto cached = std::any_of(alphas.begin(), alphas.end(), [](Alpha* a) {
+    return a && a->GetParam("signal_cache") == "true";
+  });
+  if (cached) {
+    try {
+      FaultScope scope;
+      auto derived = dr_.DerivedVersion();
+      auto data_version = Hash(&derived, sizeof(derived), dr_.version());
+      for (auto alpha : alphas) {
+        if (alpha) alpha->LoadSignal(data_version);
+      }
+    } catch (const FatalError& err) {
+      LOG_ERROR("AlphaRegistry: signal cache not used: " << err.what());
+    }
+  }
+  for (auto alpha : alphas) {
+    if (alpha) Add(alpha);
+  }
+}
+
+void AlphaRegistry::Clear() {
+  for (auto& pair : alphas_) delete pair.second;
+  alphas_.clear();
+  libraries_.clear();
+  errors_.clear();
+}
+
+void AlphaRegistry::LogErrors() const {
+  std::map<std::string, std::pair<int, std::string>> errors;
+  for (auto& pair : errors_) errors[pair.first] = {0, pair.second};
+  for (auto& pair : alphas_) {
+    auto alpha = pair.second;
+    if (alpha->error_.size()) {
+      errors[pair.first] = {alpha->pruned_date_, alpha->error_};
+    }
+  }
+  if (errors.empty()) return;
+  std::ostringstream os;
+  for (auto& pair : errors) {
+    os << "\n" << pair.first << " " << pair.second.first << ": "
+       << pair.second.second;
+  }
+  LOG_ERROR("AlphaRegistry: " << errors.size() << " alpha(s) failed"
+                              << os.str());
+}
+
 void AlphaRegistry::Run() {
+  Scope scope(this);
+  // alphas with the same universe, delay and group neutralization share
+  // the valid instruments and are calculated in batch; combiners run after
+  // the alphas they blend on each date
+  std::map<std::string, std::vector<Alpha*>> batches;
+  std::vector<std::vector<Alpha*>> groups;
+  std::vector<Alpha*> combiners;
+  for (auto& pair : alphas_) {
+    auto alpha = pair.second;
+    auto combiner = dynamic_cast<Combiner*>(alpha);
+    if (combiner) {
+      try {
+        FaultScope scope;
+        combiner->Bind(alphas_);
+      } catch (const FatalError& err) {
+        combiner->Quarantine(err.what());
+        continue;
+      }
+      combiners.push_back(combiner);
+      // blended alphas run to the end
+      for (auto a : combiner->alphas()) a->prune_rules_.clear();
+    } else if (alpha->factors_ || alpha->GetParam("batch") == "false") {
+      groups.push_back({alpha});
+    } else {
+      auto key = std::to_string(alpha->universe_) + "," +
+                 std::to_string(alpha->delay_) + "," + alpha->group_;
+      batches[key].push_back(alpha);
+    }
+  }
+  for (auto& pair : batches) groups.push_back(pair.second);
+  // with pinned threads, groups are spread over the numa nodes by number of
+  // alphas and the date loop moves to the node of each group, so that the
+  // pages of its buffers are first touched there
+  auto& memory = Memory::Instance();
+  auto num_nodes = memory.pin_threads() ? memory.num_nodes() : 1;
+  std::vector<int> nodes(groups.size());
+  if (num_nodes > 1) {
+    std::vector<size_t> loads(num_nodes);
+    std::vector<std::pair<int, std::vector<Alpha*>>> placed;
+    for (auto& group : groups) {
+      auto node = std::min_element(loads.begin(), loads.end()) - loads.begin();
+      loads[node] += group.size();
+      placed.emplace_back(node, std::move(group));
+    }
+    std::stable_sort(placed.begin(), placed.end(), [](auto& a, auto& b) {
+      return a.first < b.first;
+    });
+    for (auto i = 0u; i < placed.size(); ++i) {
+      nodes[i] = placed[i].first;
+      groups[i] = std::move(placed[i].second);
+    }
+    for (auto node = 0; node < num_nodes; ++node) {
+      LOG_INFO("Memory: " << loads[node] << " alphas on node " << node);
+    }
+  }
+  // combiners run after the alphas they blend
+  for (auto combiner : combiners) {
+    groups.push_back({combiner});
+    nodes.push_back(0);
+  }
   auto num_dates = dr_.GetData("date").num_rows();
+  std::vector<Alpha*> batch;
+  std::vector<Alpha*> deferred;
   for (auto di = 0; di < num_dates - 1; ++di) {
-    for (auto& pair : alphas_) {
-      auto alpha = pair.second;
-      if (di < alpha->lookback_days_ + alpha->delay_) continue;
-      alpha->UpdateValid(di);
-      alpha->Generate(di, alpha->alpha_[di]);
-      alpha->Calculate(di);
+    dr_.Prefetch();
+    for (auto gi = 0u; gi < groups.size(); ++gi) {
+      auto& group = groups[gi];
+      if (num_nodes > 1 && nodes[gi] != Memory::CurrentNode()) {
+        memory.RunOnNode(nodes[gi]);
+      }
+      batch.clear();
+      deferred.clear();
+      for (auto alpha : group) {
+        if (di < alpha->lookback_days_ + alpha->delay_) continue;
+        if (alpha->pruned_.size()) continue;
+        // a failure of the alpha only stops itself
+        try {
+          FaultScope scope;
+          if (batch.empty()) {
+            alpha->UpdateValid(di);
+          } else {
+            alpha->universe_list_ = batch[0]->universe_list_;
+            auto valid = alpha->valid_[di - alpha->delay_];
+            for (auto ii : alpha->universe_list_) valid[ii] = true;
+          }
+          if (!alpha->signal_cached_) {
+            std::fill_n(alpha->alpha_[di], alpha->num_instruments_, kNaN);
+            auto py = dynamic_cast<PyAlpha*>(alpha);
+            if (py && py->interpreter()) {
+              deferred.push_back(alpha);
+            } else {
+              alpha->Guard(
+                  [alpha, di] { alpha->Generate(di, alpha->alpha_[di]); });
+            }
+          }
+        } catch (const FatalError& err) {
+          alpha->Quarantine(err.what(), alpha->date(di));
+          continue;
+        }
+        batch.push_back(alpha);
+      }
+      // python alphas of different interpreters hold different GILs
+      if (deferred.size()) {
+        PyInterpreter::Unlock unlock;
+        TaskPool::Instance().ParallelFor(
+            0, deferred.size(),
+            [this, &deferred, di](int i0, int i1) {
+              Scope scope(this);
+              for (auto i = i0; i < i1; ++i) {
+                auto alpha = deferred[i];
+                try {
+                  FaultScope scope;
+                  alpha->Generate(di, alpha->alpha_[di]);
+                } catch (const FatalError& err) {
+                  alpha->Quarantine(err.what(), alpha->date(di));
+                }
+              }
+            },
+            1);
+        batch.erase(std::remove_if(batch.begin(), batch.end(),
+                                   [](Alpha* a) { return a->pruned_.size(); }),
+                    batch.end());
+      }
+      try {
+        FaultScope scope;
+        if (batch.size() > 1) {
+          Alpha::Calculate(batch, di);
+        } else if (batch.size() == 1) {
+          batch[0]->Calculate(di);
+        }
+      } catch (const FatalError& err) {
+        for (auto alpha : batch) alpha->Quarantine(err.what(), alpha->date(di));
+      }
+      for (auto alpha : batch) alpha->Prune(di);
     }
+    dr_.Trim();
+  }
+  // every alpha of the run counts as a trial of the deflated sharpe ratio
+  std::vector<double> irs;
+  for (auto& pair : alphas_) {
+    auto& perf = pair.second->perf_;
+    if (perf.size() > 1) irs.push_back(perf.Window(0, perf.size(), false).ir);
+  }
+  auto trials = SharpeTrials::Of(irs);
+  for (auto& pair : alphas_) {
+    pair.second->Report(trials);
+    if (on_report_) on_report_(*pair.second);
   }
-  for (auto& pair : alphas_) pair.second->Report();
+  LogErrors();
+  auto stats = dr_.cache_stats();
+  LOG_INFO("DataRegistry: hits=" << stats.hits << " misses=" << stats.misses
+                                 << " evictions=" << stats.evictions
+                                 << " peak=" << (stats.peak_bytes >> 20)
+                                 << "MB");
 }
 
 }  // namespace openalpha
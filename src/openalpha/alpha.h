@@ -1,12 +1,22 @@
 #ifndef OPENALPHA_ALPHA_H_
 #define OPENALPHA_ALPHA_H_
 
+#include <boost/property_tree/ptree.hpp>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "common.h"
+#include "cost.h"
 #include "data.h"
+#include "factor.h"
+#include "interpreter.h"
+#include "perf.h"
+#include "pool.h"
+#include "significance.h"
 
 namespace openalpha {
 
@@ -14,11 +24,15 @@ inline const std::string kNeutralizationByMarket = "market";
 inline const std::string kNeutralizationBySector = "sector";
 inline const std::string kNeutralizationByIndustry = "industry";
 inline const std::string kNeutralizationBySubIndustry = "subindustry";
-static const char* kApiVersion = "1";
+inline const std::string kWeightsEqual = "equal";
+inline const std::string kWeightsInverseVol = "inverse_vol";
+inline const std::string kWeightsStatic = "static";
+static const char* kApiVersion = "2";
 
 class Alpha {
  public:
   typedef std::unordered_map<std::string, std::string> ParamMap;
+  virtual ~Alpha();
   Alpha* Initialize(const std::string& name, ParamMap&& params);
   const std::string& name() const { return name_; }
   auto delay() const { return delay_; }
@@ -29,6 +43,9 @@ class Alpha {
   const bool** valid() const { return (const bool**)valid_; }
   const bool* valid(int di) const { return valid()[di]; }
   bool valid(int di, int ii) const { return valid(di)[ii]; }
+  // sorted instruments of the current universe, i.e. valid(di - delay())
+  // in Generate(di)
+  const std::vector<int>& universe_list() const { return universe_list_; }
   auto date(int di) const { return date_[di]; }
   const std::string& GetParam(const std::string& name) const {
     return FindInMap(params_, name);
@@ -36,13 +53,53 @@ class Alpha {
   std::string GetVersion() const { return kApiVersion; }
   const ParamMap& params() const { return params_; }
   DataRegistry& dr() { return dr_; }
+  const PerfSeries& perf() const { return perf_; }
+  // the prune rule which stopped the alpha, "error" if it failed, empty
+  // while running
+  const std::string& pruned() const { return pruned_; }
+  const std::string& error() const { return error_; }
+  // the rows of perf.csv, once the run is reported
+  const std::string& report() const { return report_; }
   virtual void Initialize() {}
   virtual void Generate(int di, double* alpha) = 0;
+  // date di of this alpha alone, as AlphaRegistry::Run does out of any
+  // batch, for tools timing the engine; from first_date()
+  void GenerateDate(int di);
+  void CalculateDate(int di) { Calculate(di); }
+  int first_date() const { return lookback_days_ + delay_; }
+  // func(i0, i1) on chunks of [begin, end) in the TaskPool shared with the
+  // engine and the other alphas, instead of OpenMP threads of its own
+  void ParallelFor(int begin, int end, const TaskPool::RangeFunc& func,
+                   int grain = 0) const {
+    TaskPool::Instance().ParallelFor(begin, end, func, grain);
+  }
+  // reduce of init and func(i0, i1) of fixed chunks in order, the same
+  // whatever the number of threads
+  template <typename T, typename F, typename R = std::plus<T>>
+  T ParallelReduce(int begin, int end, T init, F func, R reduce = R(),
+                   int grain = 0) const {
+    if (end <= begin) return init;
+    if (grain <= 0) grain = std::max(1, (end - begin + 63) / 64);
+    auto n = (end - begin + grain - 1) / grain;
+    std::vector<T> parts(n);
+    ParallelFor(
+        0, n,
+        [&](int c0, int c1) {
+          for (auto c = c0; c < c1; ++c) {
+            auto i0 = begin + c * grain;
+            parts[c] = func(i0, std::min(end, i0 + grain));
+          }
+        },
+        1);
+    for (auto& part : parts) init = reduce(init, part);
+    return init;
+  }
 
   struct Stats {
     int date = 0;
     double ret = kNaN;
     double pnl = kNaN;
+    double cost = 0;
     double tvr = kNaN;
     double long_pos = kNaN;
     double short_pos = kNaN;
@@ -51,11 +108,46 @@ class Alpha {
   };
 
  private:
-  void UpdateValid(int di);
+  virtual void UpdateValid(int di);
+  void Rotate();
+  double Decay(int di, int ii) const;
   void Calculate(int di);
-  void Report();
+  enum { kAuto = -1, kMarket, kGroup, kFactors };
+  typedef void (Alpha::*CalculateFunc)(int di);
+  // Calculate specialized on neutralization kind, decay and cap, kAuto for
+  // the generic version checking them at runtime
+  template <int kNeutralization, int kDecay, int kCap>
+  void CalculateImpl(int di);
+  static CalculateFunc SelectCalculate(int neutralization, bool decay,
+                                       bool cap);
+  // Calculate of alphas sharing universe, delay and group neutralization
+  static void Calculate(const std::vector<Alpha*>& alphas, int di);
+  // record stats of date di after pos_ and held_ are set
+  void Record(int di, const double* close0, double pnl, double long_pos,
+              double short_pos, double sh_hld, double nlong, double nshort);
+  // check the prune rules after date di is recorded, and release the
+  // buffers if one of them is hit
+  bool Prune(int di);
+  // stop the alpha after a failure on date, keeping the results so far
+  void Quarantine(const std::string& error, int date = 0);
+  void Release();
+  // raw rows persisted across runs, see signal.cc; data_version is of the
+  // data files and the derived fields
+  void LoadSignal(uint64_t data_version);
+  uint64_t SignalKey(uint64_t data_version) const;
+  bool ReadSignal();
+  void WriteSignal();
+  // run a call of the alpha's own code, with the crash guard if enabled
+  template <typename F>
+  void Guard(F&& f);
+  void Report(const SharpeTrials& trials);
 
  private:
+  struct PruneRule {
+    std::string kind;
+    double threshold = 0;
+    int after = 0;  // number of dates recorded before checking
+  };
   DataRegistry& dr_ = DataRegistry::Instance();
   std::string name_;
   ParamMap params_;
@@ -66,38 +158,119 @@ class Alpha {
   double max_stock_weight_ = 0.1;
   double book_size_ = 2e7;
   std::string neutralization_ = kNeutralizationBySubIndustry;
+  std::string group_ = kNeutralizationBySubIndustry;
+  int neutralization_kind_ = kGroup;
+  std::shared_ptr<FactorModel> factors_;
   double** alpha_ = nullptr;
   bool** valid_ = nullptr;
   int num_dates_ = 0;
   int num_instruments_ = 0;
   std::vector<int64_t> int_array_;
-  std::vector<double> double_array_;
+  std::vector<int> universe_list_;
+  std::vector<int> held_;
+  std::vector<int> held_1_;
+  std::vector<int> traded_;
   std::vector<double> pos_;
+  std::vector<double> pos_1_;
+  std::vector<std::unique_ptr<CostModel>> cost_models_;
+  std::vector<double> cost_linear_;
+  std::vector<double> cost_impact_;
   std::vector<Stats> stats_;
+  PerfSeries perf_;
+  std::vector<PruneRule> prune_rules_;
+  std::string pruned_;
+  std::string error_;
+  std::string report_;
+  int pruned_date_ = 0;
+  bool crash_guard_ = false;
+  uint64_t signal_key_ = 0;  // 0 without signal_cache
+  bool signal_cached_ = false;
   const int64_t* date_ = nullptr;
+  CalculateFunc calculate_ = nullptr;
   std::ofstream os_;
   friend class AlphaRegistry;
   friend class PyAlpha;
+  friend class Combiner;
 };
 
 class PyAlpha : public Alpha {
  public:
+  ~PyAlpha() override;
   Alpha* Initialize(const std::string& name, ParamMap&& params);
   void Generate(int di, double* alpha) override;
+  // own sub-interpreter, whose alphas generate in parallel, null if none
+  PyInterpreter* interpreter() const { return interpreter_.get(); }
 
  private:
+  std::string module_name_;
   bp::object generate_func_;
+  std::shared_ptr<PyInterpreter> interpreter_;
+};
+
+// Blends the daily positions of other alphas into one book, which then goes
+// through the normal neutralization, capping and pnl calculation.
+class Combiner : public Alpha {
+ public:
+  Combiner() {
+    delay_ = 0;
+    decay_ = 1;
+    lookback_days_ = 0;
+  }
+  Alpha* Initialize(const std::string& name, ParamMap&& params);
+  void Bind(const std::unordered_map<std::string, Alpha*>& alphas);
+  void Generate(int di, double* alpha) override;
+  const std::vector<Alpha*>& alphas() const { return alphas_; }
+
+ private:
+  void UpdateValid(int di) override {}
+  void UpdateWeights(int di);
+
+ private:
+  std::vector<std::string> names_;
+  std::vector<Alpha*> alphas_;
+  std::vector<double> weights_;
+  std::string weighting_ = kWeightsEqual;
+  int vol_window_ = 63;
 };
 
 class AlphaRegistry : public Singleton<AlphaRegistry> {
  public:
   typedef std::unordered_map<std::string, Alpha*> AlphaMap;
+  typedef std::function<void(const Alpha&)> ReportFunc;
+  // the registry being loaded or run on the calling thread, the singleton
+  // out of any
+  static AlphaRegistry& Current();
+  // makes registry the current one of the thread until destroyed
+  class Scope {
+   public:
+    explicit Scope(AlphaRegistry* registry);
+    ~Scope();
+
+   private:
+    AlphaRegistry* prev_;
+  };
   void Add(Alpha* alpha) { alphas_[alpha->name()] = alpha; }
+  Alpha* Get(const std::string& name) const { return FindInMap(alphas_, name); }
+  // create and add the alphas of the config sections
+  void Load(const boost::property_tree::ptree& config);
   void Run();
+  // called by Run() with each alpha as soon as it is reported
+  void set_on_report(ReportFunc func) { on_report_ = std::move(func); }
+  // delete the alphas, then release their libraries
+  void Clear();
+
+ private:
+  Alpha* Create(const std::string& name, Alpha::ParamMap&& params);
+  void LogErrors() const;
 
  private:
   DataRegistry& dr_ = DataRegistry::Instance();
   AlphaMap alphas_;
+  std::vector<std::shared_ptr<void>> libraries_;
+  // alphas failed to be created or bound, with the errors
+  std::vector<std::pair<std::string, std::string>> errors_;
+  ReportFunc on_report_;
+  std::mutex mutex_;
 };
 
 }  // namespace openalpha
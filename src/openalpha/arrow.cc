@@ -0,0 +1,254 @@
+#ifdef OPENALPHA_ARROW
+
+#include <arrow/api.h>
+#include <arrow/io/api.h>
+#include <arrow/ipc/api.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "storage.h"
+
+namespace openalpha {
+
+// Arrow IPC files (Feather v2). A table is either one fixed_size_list column
+// holding the row of instruments of each date, as written by openalpha-data,
+// or one column per instrument, as written by pandas. The rows of an
+// uncompressed file with a single record batch of the first layout, or of
+// one column, are mapped without copy.
+class ArrowStorage : public Storage {
+ public:
+  std::vector<std::string> extensions() const override {
+    return {".arrow", ".feather"};
+  }
+  Table Load(const std::string& name, const std::string& path,
+             bool map) override;
+};
+
+Storage* NewArrowStorage() { return new ArrowStorage; }
+
+template <typename T>
+static T Check(arrow::Result<T> result, const std::string& name) {
+  if (!result.ok()) {
+    LOG_FATAL("DataRegistry: failed to load '"
+              << name << "': " << result.status().ToString());
+  }
+  return std::move(result).ValueOrDie();
+}
+
+static Table::Type ItemType(const arrow::DataType& type, int* item_size) {
+  switch (type.id()) {
+    case arrow::Type::DOUBLE:
+      *item_size = 8;
+      return Table::kDouble;
+    case arrow::Type::FLOAT:
+      *item_size = 4;
+      return Table::kFloat;
+    case arrow::Type::INT64:
+      *item_size = 8;
+      return Table::kInt64;
+    case arrow::Type::INT32:
+      *item_size = 4;
+      return Table::kInt32;
+    case arrow::Type::INT16:
+      *item_size = 2;
+      return Table::kInt16;
+    case arrow::Type::INT8:
+      *item_size = 1;
+      return Table::kInt8;
+    case arrow::Type::FIXED_SIZE_BINARY:
+      *item_size =
+          static_cast<const arrow::FixedSizeBinaryType&>(type).byte_width();
+      return Table::kString;
+    case arrow::Type::STRING:
+      // the width of the longest string
+      *item_size = 0;
+      return Table::kString;
+    default:
+      return Table::kUnknown;
+  }
+}
+
+// n items of array from index i0 to out with stride, nulls as NaN or 0
+template <typename T>
+static void CopyItems(const arrow::Array& array, int64_t i0, int64_t n,
+                      T* out, size_t stride) {
+  auto values = array.data()->GetValues<T>(1);
+  auto null = std::numeric_limits<T>::has_quiet_NaN
+                  ? std::numeric_limits<T>::quiet_NaN()
+                  : T(0);
+  auto has_nulls = array.null_count() > 0;
+  for (int64_t i = 0; i < n; ++i) {
+    out[i * stride] =
+        has_nulls && array.IsNull(i0 + i) ? null : values[i0 + i];
+  }
+}
+
+static void CopyStrings(const arrow::Array& array, int64_t i0, int64_t n,
+                        char* out, size_t stride, int item_size) {
+  for (int64_t i = 0; i < n; ++i) {
+    if (array.IsNull(i0 + i)) continue;
+    auto p = out + i * stride * item_size;
+    if (array.type_id() == arrow::Type::STRING) {
+      auto view =
+          static_cast<const arrow::StringArray&>(array).GetView(i0 + i);
+      memcpy(p, view.data(), view.size());
+    } else {
+      memcpy(p, static_cast<const arrow::FixedSizeBinaryArray&>(array)
+                    .GetValue(i0 + i),
+             item_size);
+    }
+  }
+}
+
+static void Copy(const arrow::Array& array, int64_t i0, int64_t n,
+                 Table::Type type, int item_size, char* out, size_t stride) {
+  switch (type) {
+    case Table::kDouble:
+      return CopyItems(array, i0, n, reinterpret_cast<double*>(out), stride);
+    case Table::kFloat:
+      return CopyItems(array, i0, n, reinterpret_cast<float*>(out), stride);
+    case Table::kInt64:
+      return CopyItems(array, i0, n, reinterpret_cast<int64_t*>(out), stride);
+    case Table::kInt32:
+      return CopyItems(array, i0, n, reinterpret_cast<int32_t*>(out), stride);
+    case Table::kInt16:
+      return CopyItems(array, i0, n, reinterpret_cast<int16_t*>(out), stride);
+    case Table::kInt8:
+      return CopyItems(array, i0, n, reinterpret_cast<int8_t*>(out), stride);
+    default:
+      return CopyStrings(array, i0, n, out, stride, item_size);
+  }
+}
+
+Table ArrowStorage::Load(const std::string& name, const std::string& path,
+                         bool map) {
+  std::shared_ptr<MappedData> mapped;
+  std::shared_ptr<arrow::io::RandomAccessFile> file;
+  if (map) mapped = Map(path, 0, fs::file_size(path));
+  if (mapped) {
+    // buffers of an uncompressed file point into the mapping
+    file = std::make_shared<arrow::io::BufferReader>(
+        std::make_shared<arrow::Buffer>(
+            reinterpret_cast<const uint8_t*>(mapped->ptr), mapped->size));
+  } else {
+    file = Check(arrow::io::ReadableFile::Open(path), name);
+  }
+  auto reader = Check(arrow::ipc::RecordBatchFileReader::Open(file), name);
+  auto schema = reader->schema();
+  if (schema->num_fields() == 0) {
+    LOG_FATAL("DataRegistry: '" << name << "' has no column");
+  }
+  std::vector<std::shared_ptr<arrow::RecordBatch>> batches;
+  int64_t num_rows = 0;
+  for (auto i = 0; i < reader->num_record_batches(); ++i) {
+    batches.push_back(Check(reader->ReadRecordBatch(i), name));
+    num_rows += batches.back()->num_rows();
+  }
+
+  auto first = schema->field(0)->type();
+  auto row_major = schema->num_fields() == 1 &&
+                   first->id() == arrow::Type::FIXED_SIZE_LIST;
+  auto item = first;
+  int num_columns = schema->num_fields();
+  if (row_major) {
+    auto& list = static_cast<const arrow::FixedSizeListType&>(*first);
+    item = list.value_type();
+    num_columns = list.list_size();
+  }
+  int item_size = 0;
+  auto type = ItemType(*item, &item_size);
+  for (auto& field : schema->fields()) {
+    auto same = row_major || field->type()->Equals(item);
+    if (type == Table::kUnknown || !same) {
+      LOG_FATAL("DataRegistry: '" << name << "' has column type '"
+                                  << field->type()->ToString()
+                                  << "' which is not supported in openalpha");
+    }
+  }
+  // the values of column j of a batch from item i0
+  auto values = [row_major](const arrow::RecordBatch& batch, int j,
+                            int64_t* i0) {
+    auto column = batch.column(row_major ? 0 : j);
+    *i0 = 0;
+    if (!row_major) return column;
+    auto& list = static_cast<const arrow::FixedSizeListArray&>(*column);
+    *i0 = list.value_offset(0);
+    return list.values();
+  };
+  if (type == Table::kString && !item_size) {
+    for (auto& batch : batches) {
+      for (auto j = 0; j < (row_major ? 1 : num_columns); ++j) {
+        int64_t i0;
+        auto array = values(*batch, j, &i0);
+        auto& strings = static_cast<const arrow::StringArray&>(*array);
+        auto n = batch->num_rows() * (row_major ? num_columns : 1);
+        for (int64_t i = 0; i < n; ++i) {
+          item_size = std::max(item_size, strings.value_length(i0 + i));
+        }
+      }
+    }
+    item_size = std::max(item_size, 1);
+  }
+  Table out;
+  SetShape(&out, name, num_rows, num_columns, type, item->ToString());
+  auto n = size_t(num_rows) * num_columns;
+  auto num_bytes = n * item_size;
+
+  if (mapped && batches.size() == 1 && type != Table::kString &&
+      (row_major || num_columns == 1)) {
+    int64_t i0;
+    auto array = values(*batches[0], 0, &i0);
+    auto& buffer = array->data()->buffers[1];
+    auto ptr = reinterpret_cast<char*>(mapped->ptr);
+    auto data = buffer ? reinterpret_cast<const char*>(buffer->data()) +
+                             (array->offset() + i0) * item_size
+                       : nullptr;
+    if (!array->null_count() && data >= ptr &&
+        data + num_bytes <= ptr + mapped->size) {
+      mapped->ptr = const_cast<char*>(data);
+      SetData(&out, mapped, num_bytes);
+      LOG_INFO("DataRegistry: " << name << " mapped");
+      return out;
+    }
+  }
+
+  std::shared_ptr<AllocatedData> allocated;
+  char* raw;
+  if (type == Table::kString) {
+    raw = new char[num_bytes]();
+  } else {
+    allocated = std::make_shared<AllocatedData>(num_bytes);
+    raw = reinterpret_cast<char*>(allocated->ptr);
+  }
+  size_t row = 0;
+  for (auto& batch : batches) {
+    auto dest = raw + row * num_columns * item_size;
+    if (row_major) {
+      int64_t i0;
+      auto array = values(*batch, 0, &i0);
+      Copy(*array, i0, batch->num_rows() * num_columns, type, item_size, dest,
+           1);
+    } else {
+      for (auto j = 0; j < num_columns; ++j) {
+        int64_t i0;
+        auto array = values(*batch, j, &i0);
+        Copy(*array, i0, batch->num_rows(), type, item_size,
+             dest + j * item_size, num_columns);
+      }
+    }
+    row += batch->num_rows();
+  }
+  if (type == Table::kString) {
+    SetStrings(&out, raw, item_size);
+  } else {
+    allocated->Replicate();
+    SetData(&out, allocated, num_bytes);
+  }
+  LOG_INFO("DataRegistry: " << name << " loaded");
+  return out;
+}
+
+}  // namespace openalpha
+
+#endif  // OPENALPHA_ARROW
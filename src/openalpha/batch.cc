@@ -0,0 +1,172 @@
+#include <map>
+
+#include "alpha.h"
+
+namespace openalpha {
+
+// Same as Alpha::Calculate, but for K alphas sharing universe, delay and
+// group neutralization. The close, group and valid rows are read once, the
+// returns are computed once, and positions are kept alpha-interleaved, i.e.
+// x[u * K + k] for the u-th universe instrument of the k-th alpha, so that
+// group statistics and pnl are vectorized over alphas.
+void Alpha::Calculate(const std::vector<Alpha*>& alphas, int di) {
+  auto a0 = alphas[0];
+  auto& dr = a0->dr_;
+  auto delay = a0->delay_;
+  const int nk = alphas.size();
+  auto& iis = a0->universe_list_;
+  const int nu = iis.size();
+  auto groups = a0->group_.size()
+                    ? dr.GetData(a0->group_).Row<int64_t>(di - delay)
+                    : nullptr;
+  auto valid = a0->valid_[di - delay];
+  auto close = dr.GetData("close");
+  auto close0 = close.Row<double>(di);
+  auto close1 = close.Row<double>(di + 1);
+
+  thread_local std::vector<double> x;
+  thread_local std::vector<double> rets;
+  x.assign(nu * nk, kNaN);
+  rets.resize(nu);
+  std::map<int64_t, std::vector<int>> grouped;
+  for (auto u = 0; u < nu; ++u) {
+    auto ii = iis[u];
+    auto px0 = close0[ii];
+    auto px1 = close1[ii];
+    rets[u] = !(px0 > 0) || !(px1 > 0) ? 0 : (px1 / px0 - 1);
+    if (!valid[ii]) continue;
+    auto ig = groups ? groups[ii] : 0;
+    if (ig < 0) continue;
+    grouped[ig].push_back(u);
+  }
+  for (auto k = 0; k < nk; ++k) {
+    auto a = alphas[k];
+    a->Rotate();
+    auto alpha = a->alpha_[di];
+    for (auto& pair : grouped) {
+      for (auto u : pair.second) {
+        auto ii = iis[u];
+        auto v = alpha[ii];
+        if (std::isnan(v)) continue;
+        if (a->decay_ > 1) v = a->Decay(di, ii);
+        x[u * nk + k] = v;
+      }
+    }
+  }
+
+  std::vector<double> sums(nk);
+  std::vector<double> sum2(nk);
+  std::vector<int> counts(nk);
+  std::vector<char> active(nk, 1);
+  std::vector<char> dead(nk, 0);
+  auto max_try = 10;
+  for (auto itry = 0; itry <= max_try; ++itry) {
+    for (auto k = 0; k < nk; ++k) {
+      if (active[k]) sums[k] = 0;
+    }
+    for (auto& pair : grouped) {
+      std::fill(sum2.begin(), sum2.end(), 0.);
+      std::fill(counts.begin(), counts.end(), 0);
+      for (auto u : pair.second) {
+        auto row = &x[u * nk];
+        for (auto k = 0; k < nk; ++k) {
+          auto v = row[k];
+          auto held = !std::isnan(v);
+          sum2[k] += held ? v : 0.;
+          counts[k] += held;
+        }
+      }
+      for (auto k = 0; k < nk; ++k) {
+        if (!active[k]) {
+          sum2[k] = 0;
+        } else if (counts[k] == 1) {
+          // single instrument group can't be neutralized
+          sum2[k] = kNaN;
+        } else if (counts[k] > 1) {
+          sum2[k] /= counts[k];
+        }
+      }
+      for (auto u : pair.second) {
+        auto row = &x[u * nk];
+        for (auto k = 0; k < nk; ++k) {
+          auto v = row[k] - sum2[k];
+          row[k] = v;
+          sums[k] += active[k] && !std::isnan(v) ? std::abs(v) : 0.;
+        }
+      }
+    }
+    auto any = false;
+    for (auto k = 0; k < nk; ++k) {
+      if (!active[k]) continue;
+      auto a = alphas[k];
+      if (sums[k] == 0) {
+        dead[k] = 1;
+        active[k] = 0;
+        continue;
+      }
+      if (a->max_stock_weight_ <= 0 || itry == max_try) {
+        active[k] = 0;
+        continue;
+      }
+      auto max_value = a->max_stock_weight_ * sums[k];
+      auto threshold = max_value * 1.01;
+      auto breach = false;
+      for (auto u = 0; u < nu && !breach; ++u) {
+        breach = std::abs(x[u * nk + k]) > threshold;
+      }
+      if (!breach) {
+        active[k] = 0;
+        continue;
+      }
+      for (auto u = 0; u < nu; ++u) {
+        auto& v = x[u * nk + k];
+        if (std::abs(v) > max_value) v = max_value * (v > 0 ? 1 : -1);
+      }
+      any = true;
+    }
+    if (!any) break;
+  }
+
+  std::vector<double> pnl(nk);
+  std::vector<double> long_pos(nk);
+  std::vector<double> short_pos(nk);
+  std::vector<double> sh_hld(nk);
+  std::vector<double> nlong(nk);
+  std::vector<double> nshort(nk);
+  for (auto u = 0; u < nu; ++u) {
+    auto ii = iis[u];
+    auto ret = rets[u];
+    auto px0 = close0[ii];
+    auto row = &x[u * nk];
+    for (auto k = 0; k < nk; ++k) {
+      auto v = row[k];
+      if (std::isnan(v) || dead[k]) continue;
+      v = std::round(v / sums[k] * alphas[k]->book_size_);
+      row[k] = v;
+      pnl[k] += v * ret;
+      if (v > 0) {
+        long_pos[k] += v;
+        nlong[k]++;
+      } else if (v < 0) {
+        short_pos[k] -= v;
+        nshort[k]++;
+      }
+      if (px0 > 0) sh_hld[k] += std::abs(v) / px0;
+    }
+  }
+  for (auto k = 0; k < nk; ++k) {
+    if (dead[k]) continue;
+    auto a = alphas[k];
+    for (auto u = 0; u < nu; ++u) {
+      auto v = x[u * nk + k];
+      if (std::isnan(v)) continue;
+      auto ii = iis[u];
+      a->pos_[ii] = v;
+      a->held_.push_back(ii);
+    }
+    a->Record(di, close0, pnl[k], long_pos[k], short_pos[k], sh_hld[k],
+              nlong[k], nshort[k]);
+  }
+}
+
+}  // namespace openalpha
@@ -46,6 +46,19 @@ const typename V::mapped_type& FindInMap(std::shared_ptr<V> map,
   return it->second;
 }
 
+// 64-bit FNV-1a, stable across runs and builds unlike std::hash
+inline uint64_t Hash(const void* data, size_t size,
+                     uint64_t h = 14695981039346656037ull) {
+  auto p = static_cast<const unsigned char*>(data);
+  for (auto i = 0u; i < size; ++i) h = (h ^ p[i]) * 1099511628211ull;
+  return h;
+}
+
+inline uint64_t Hash(const std::string& s,
+                     uint64_t h = 14695981039346656037ull) {
+  return Hash(s.data(), s.size(), h);
+}
+
 template <typename T>
 std::vector<int> ArgSort(const T& in, size_t n) {
   std::vector<int> out(n, 0);
@@ -0,0 +1,58 @@
+#include "cost.h"
+
+#include <boost/algorithm/string.hpp>
+#include <cmath>
+#include <vector>
+
+#include "logger.h"
+
+namespace openalpha {
+
+std::unique_ptr<CostModel> CostModel::Create(const std::string& spec) {
+  std::vector<std::string> toks;
+  boost::split(toks, spec, boost::is_any_of(":"));
+  auto& name = toks[0];
+  if (name == kCostBps) {
+    if (toks.size() < 2) {
+      LOG_FATAL("CostModel: '" << spec << "': bps value is required");
+    }
+    return std::make_unique<BpsCost>(atof(toks[1].c_str()));
+  } else if (name == kCostSpread) {
+    return std::make_unique<SpreadCost>(toks.size() > 1 ? toks[1] : "spread");
+  } else if (name == kCostImpact) {
+    auto coefficient = toks.size() > 1 ? atof(toks[1].c_str()) : 1.;
+    return std::make_unique<ImpactCost>(
+        coefficient, toks.size() > 2 ? toks[2] : "volatility");
+  }
+  LOG_FATAL("CostModel: invalid cost model '"
+            << spec << "', expected '" << kCostBps << "', '" << kCostSpread
+            << "' or '" << kCostImpact << "'");
+  return {};
+}
+
+void BpsCost::Update(int di, const std::vector<int>& iis, double* linear,
+                     double* impact) {
+  for (auto ii : iis) linear[ii] += rate_;
+}
+
+void SpreadCost::Update(int di, const std::vector<int>& iis,
+                        double* linear, double* impact) {
+  auto spread = dr_.GetData(field_).Row<double>(di);
+  auto close = dr_.GetData("close").Row<double>(di);
+  for (auto ii : iis) {
+    auto x = 0.5 * spread[ii] / close[ii];
+    if (x > 0 && std::isfinite(x)) linear[ii] += x;
+  }
+}
+
+void ImpactCost::Update(int di, const std::vector<int>& iis,
+                        double* linear, double* impact) {
+  auto volatility = dr_.GetData(volatility_).Row<double>(di);
+  auto adv = dr_.GetData("adv60").Row<double>(di);
+  for (auto ii : iis) {
+    auto x = coefficient_ * volatility[ii] / std::sqrt(adv[ii]);
+    if (x > 0 && std::isfinite(x)) impact[ii] += x;
+  }
+}
+
+}  // namespace openalpha
@@ -0,0 +1,71 @@
+#ifndef OPENALPHA_COST_H_
+#define OPENALPHA_COST_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "data.h"
+
+namespace openalpha {
+
+inline const std::string kCostBps = "bps";
+inline const std::string kCostSpread = "spread";
+inline const std::string kCostImpact = "impact";
+
+// Every cost model is expressed with two per-instrument coefficients, so that
+// the cost of trading x dollars of ii is x * (linear[ii] + impact[ii] *
+// sqrt(x)), which Alpha::Calculate evaluates in its turnover loop.
+class CostModel {
+ public:
+  virtual ~CostModel() {}
+  // add this model's coefficients of date di to linear and impact for the
+  // traded instruments iis
+  virtual void Update(int di, const std::vector<int>& iis, double* linear,
+                      double* impact) = 0;
+  // spec is one of "bps:<bps>", "spread[:<field>]",
+  // "impact[:<coefficient>[:<volatility field>]]"
+  static std::unique_ptr<CostModel> Create(const std::string& spec);
+
+ protected:
+  DataRegistry& dr_ = DataRegistry::Instance();
+};
+
+// fixed cost in basis points of traded amount
+class BpsCost : public CostModel {
+ public:
+  explicit BpsCost(double bps) : rate_(bps * 1e-4) {}
+  void Update(int di, const std::vector<int>& iis, double* linear,
+              double* impact) override;
+
+ private:
+  double rate_;
+};
+
+// pay half of the quoted spread, spread is in price unit like close
+class SpreadCost : public CostModel {
+ public:
+  explicit SpreadCost(const std::string& field) : field_(field) {}
+  void Update(int di, const std::vector<int>& iis, double* linear,
+              double* impact) override;
+
+ private:
+  std::string field_;
+};
+
+// square-root market impact, coefficient * volatility * sqrt(x / adv60)
+class ImpactCost : public CostModel {
+ public:
+  ImpactCost(double coefficient, const std::string& volatility)
+      : coefficient_(coefficient), volatility_(volatility) {}
+  void Update(int di, const std::vector<int>& iis, double* linear,
+              double* impact) override;
+
+ private:
+  double coefficient_;
+  std::string volatility_;
+};
+
+}  // namespace openalpha
+
+#endif  // OPENALPHA_COST_H_
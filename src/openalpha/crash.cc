@@ -0,0 +1,25 @@
+#include "crash.h"
+
+#include <csignal>
+
+namespace openalpha {
+
+void CrashGuard::Install() {
+  static std::once_flag kInstalled;
+  std::call_once(kInstalled, [] {
+    struct sigaction action = {};
+    action.sa_handler = OnCrash;
+    sigemptyset(&action.sa_mask);
+    for (auto sig : {SIGSEGV, SIGBUS, SIGFPE, SIGILL}) {
+      sigaction(sig, &action, nullptr);
+    }
+  });
+}
+
+void CrashGuard::OnCrash(int sig) {
+  if (jump_ && !locks_) siglongjmp(*jump_, sig);
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+}  // namespace openalpha
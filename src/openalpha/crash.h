@@ -0,0 +1,78 @@
+#ifndef OPENALPHA_CRASH_H_
+#define OPENALPHA_CRASH_H_
+
+#include <csetjmp>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#include "logger.h"
+
+namespace openalpha {
+
+// The crash guard turns a fault signal in a guarded call into a FatalError.
+// The call is abandoned without unwinding, so memory it held is lost, which
+// is why it is optional. A fault while an engine lock is held is not
+// recovered, as the lock would stay held: the process dies as without guard.
+class CrashGuard {
+ public:
+  // std::mutex of the engine, see above
+  class Mutex {
+   public:
+    void lock() {
+      mutex_.lock();
+      ++locks_;
+    }
+    void unlock() {
+      --locks_;
+      mutex_.unlock();
+    }
+
+   private:
+    std::mutex mutex_;
+  };
+  // no guard on this thread until destroyed
+  class Suspend {
+   public:
+    Suspend() : prev_(jump_) { jump_ = nullptr; }
+    ~Suspend() { jump_ = prev_; }
+
+   private:
+    sigjmp_buf* prev_;
+  };
+  // f() with its faults thrown as FatalError of what
+  template <typename F>
+  static void Run(const std::string& what, F&& f);
+  // in a guarded call on this thread, passed on to the TaskPool chunks
+  static bool active() { return jump_ != nullptr; }
+
+ private:
+  static void Install();
+  static void OnCrash(int sig);
+  inline static thread_local sigjmp_buf* jump_ = nullptr;
+  inline static thread_local int locks_ = 0;
+};
+
+template <typename F>
+void CrashGuard::Run(const std::string& what, F&& f) {
+  Install();
+  sigjmp_buf jmp;
+  auto prev = jump_;
+  auto sig = sigsetjmp(jmp, 1);
+  if (sig) {
+    jump_ = prev;
+    LOG_FATAL(what << ": crashed with " << strsignal(sig));
+  }
+  jump_ = &jmp;
+  try {
+    f();
+  } catch (...) {
+    jump_ = prev;
+    throw;
+  }
+  jump_ = prev;
+}
+
+}  // namespace openalpha
+
+#endif  // OPENALPHA_CRASH_H_
@@ -0,0 +1,191 @@
+#include "daemon.h"
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <boost/property_tree/ini_parser.hpp>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+#include "alpha.h"
+#include "logger.h"
+#include "pool.h"
+#include "python.h"
+
+namespace openalpha {
+
+static bool WriteAll(int fd, const std::string& str) {
+  for (size_t i = 0; i < str.size();) {
+    auto n = write(fd, str.data() + i, str.size() - i);
+    if (n <= 0) return false;
+    i += n;
+  }
+  return true;
+}
+
+static std::string ReadAll(int fd) {
+  std::string out;
+  char buf[4096];
+  for (;;) {
+    auto n = read(fd, buf, sizeof(buf));
+    if (n <= 0) break;
+    out.append(buf, n);
+  }
+  return out;
+}
+
+static int Connect(const std::string& path, bool listen) {
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) return -1;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  auto ret = 0;
+  if (listen) {
+    unlink(path.c_str());
+    ret = bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    if (!ret) ret = ::listen(fd, SOMAXCONN);
+  } else {
+    ret = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  }
+  if (ret) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void Daemon::Run() {
+  auto fd = Connect(socket_path_, true);
+  if (fd < 0) {
+    LOG_FATAL("Daemon: can't listen on '" << socket_path_
+                                          << "': " << strerror(errno));
+  }
+  // a client going away must not kill the daemon
+  signal(SIGPIPE, SIG_IGN);
+  // workers take the GIL when they run python
+  PyEval_SaveThread();
+  ThreadPool pool(num_workers_);
+  LOG_INFO("Daemon: listening on '" << socket_path_ << "' with "
+                                    << num_workers_ << " workers");
+  for (;;) {
+    auto client = accept(fd, nullptr, nullptr);
+    if (client < 0) {
+      if (errno == EINTR) continue;
+      LOG_ERROR("Daemon: accept failed: " << strerror(errno));
+      break;
+    }
+    pool.Submit([this, client] {
+      // the client is closed and the daemon goes on whatever happens
+      try {
+        Serve(client);
+      } catch (const std::exception& err) {
+        LOG_ERROR("Daemon: job failed: " << err.what());
+      }
+      close(client);
+    });
+  }
+  close(fd);
+}
+
+void Daemon::Serve(int fd) {
+  auto t0 = std::chrono::steady_clock::now();
+  boost::property_tree::ptree config;
+  try {
+    std::istringstream is(ReadAll(fd));
+    boost::property_tree::ini_parser::read_ini(is, config);
+  } catch (boost::property_tree::ini_parser_error& err) {
+    WriteAll(fd, std::string("error: ") + err.what() + "\n");
+    return;
+  }
+  // alphas write their files under store/<name>/, so jobs sharing an alpha
+  // name run one after the other
+  std::set<std::string> names;
+  for (auto& section : config) {
+    if (section.second.size()) names.insert(section.first);
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this, &names] {
+      for (auto& name : names) {
+        if (busy_.count(name)) return false;
+      }
+      return true;
+    });
+    busy_.insert(names.begin(), names.end());
+  }
+  // released however the job ends
+  struct Release {
+    Daemon* daemon;
+    const std::set<std::string>& names;
+    ~Release() {
+      {
+        std::lock_guard<std::mutex> lock(daemon->mutex_);
+        for (auto& name : names) daemon->busy_.erase(name);
+      }
+      daemon->cv_.notify_all();
+    }
+  } release{this, names};
+  AlphaRegistry registry;
+  // each alpha is sent as soon as it is reported
+  auto ok = true;
+  registry.set_on_report([fd, &ok](const Alpha& alpha) {
+    if (ok) {
+      ok = WriteAll(fd, "[" + alpha.name() + "]\n" + alpha.report() + "\n");
+    }
+  });
+  // a failure of the job, LOG_FATAL included, only ends this job
+  std::string error;
+  try {
+    FaultScope scope;
+    registry.Load(config);
+    registry.Run();
+  } catch (const std::exception& err) {
+    error = err.what();
+  } catch (...) {
+    error = "unknown exception";
+  }
+  registry.Clear();
+  if (error.size()) {
+    LOG_ERROR("Daemon: job failed: " << error);
+    WriteAll(fd, "error: " + error + "\n");
+    return;
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - t0;
+  LOG_INFO("Daemon: job done in " << elapsed.count() << "s");
+}
+
+int Daemon::Submit(const std::string& socket_path,
+                   const std::string& config_file_path) {
+  std::ifstream ifs(config_file_path);
+  if (!ifs) {
+    std::cerr << config_file_path << " not found" << std::endl;
+    return 1;
+  }
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  auto fd = Connect(socket_path, false);
+  if (fd < 0) {
+    std::cerr << "can't connect to '" << socket_path
+              << "': " << strerror(errno) << std::endl;
+    return 1;
+  }
+  auto ok = WriteAll(fd, ss.str());
+  shutdown(fd, SHUT_WR);
+  char buf[4096];
+  for (;;) {
+    auto n = read(fd, buf, sizeof(buf));
+    if (n <= 0) break;
+    std::cout.write(buf, n).flush();
+  }
+  close(fd);
+  return ok ? 0 : 1;
+}
+
+}  // namespace openalpha
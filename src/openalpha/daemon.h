@@ -0,0 +1,42 @@
+#ifndef OPENALPHA_DAEMON_H_
+#define OPENALPHA_DAEMON_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+
+namespace openalpha {
+
+// Serves simulation jobs on a unix socket, keeping data, python and alpha
+// libraries loaded between jobs. A job is a config file sent by the client,
+// which then shuts down its writing side; the daemon runs it on a worker and
+// streams back the performance report of each alpha as it is done. Jobs
+// with an alpha name in common run one after the other, as they write the
+// same store files. Changed .so and .py files are loaded again by the next
+// job using them.
+class Daemon {
+ public:
+  Daemon(const std::string& socket_path, int num_workers)
+      : socket_path_(socket_path), num_workers_(num_workers) {}
+  void Run();
+  // send the config file to the daemon and print the results, returns the
+  // exit code
+  static int Submit(const std::string& socket_path,
+                    const std::string& config_file_path);
+
+ private:
+  void Serve(int fd);
+
+ private:
+  std::string socket_path_;
+  int num_workers_;
+  // alpha names of the running jobs
+  std::set<std::string> busy_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+}  // namespace openalpha
+
+#endif  // OPENALPHA_DAEMON_H_
@@ -1,94 +1,258 @@
 #include "data.h"
 
-#include <H5Cpp.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
 #include <iostream>
+#include <memory>
+#include <tuple>
 
+#include "interpreter.h"
 #include "python.h"
+#include "storage.h"
 
 namespace openalpha {
 
-static H5std_string kDatasetName("default");
-
 Table DataRegistry::GetData(const std::string& name, bool retain) {
-  auto out = array_map_[name];
-  if (retain && out) return out;
-  try {
-    H5::H5File file(H5std_string((kDataPath / (name + ".h5")).string()),
-                    H5F_ACC_RDONLY);
-    auto dataset = file.openDataSet(kDatasetName);
-    auto dataspace = dataset.getSpace();
-    hsize_t dims_out[2];
-    auto ndims = dataspace.getSimpleExtentDims(dims_out, nullptr);
-    if (ndims != 2) {
-      LOG_FATAL("DataRegistry: '" << name << "' is not 2d array");
+  Derived derived;
+  std::unique_ptr<std::promise<Table>> promise;
+  std::shared_future<Table> pending;
+  {
+    std::lock_guard<CrashGuard::Mutex> lock(mutex_);
+    auto it = array_map_.find(name);
+    if (it != array_map_.end()) {
+      auto& entry = it->second;
+      stats_.hits++;
+      entry.tick = ++tick_;
+      entry.retain |= retain;
+      return entry.table;
     }
-    auto n = dims_out[0] * dims_out[1];
-    out.num_rows_ = dims_out[0];
-    out.num_columns_ = dims_out[1];
-    out.name_ = name;
-    auto data_type = dataset.getDataType();
-    auto type_class = data_type.getClass();
-    out.type_name_ = data_type.fromClass();
-    auto data_size = data_type.getSize();
-    void* raw = new char[n * data_size]();
-    dataset.read(raw, data_type);
-    if (type_class == H5T_FLOAT) {
-      if (data_size == 4) {
-        out.type_ = Table::kFloat;
-      } else if (data_size == 8) {
-        out.type_ = Table::kDouble;
-      } else {
-        LOG_FATAL("DataRegistry: failed to load '" + name +
-                      "': unsupported double type with data size = "
-                  << data_size);
+    // a derived field is computed once, by the first thread asking for it
+    auto def = derived_.find(name);
+    if (def != derived_.end()) {
+      if (DerivingScope::Has(name)) {
+        LOG_FATAL("DataRegistry: derived field '" << name
+                                                  << "' depends on itself");
       }
-      out.data_ = std::make_shared<Table::RawData>();
-      out.data_->ptr = raw;
-    } else if (type_class == H5T_INTEGER) {
-      if (data_size == 1) {
-        out.type_ = Table::kInt8;
-      } else if (data_size == 2) {
-        out.type_ = Table::kInt16;
-      } else if (data_size == 4) {
-        out.type_ = Table::kInt32;
-      } else if (data_size == 8) {
-        out.type_ = Table::kInt64;
+      auto deriving = deriving_.find(name);
+      if (deriving == deriving_.end()) {
+        derived = def->second;
+        promise.reset(new std::promise<Table>);
+        deriving_[name] = promise->get_future().share();
       } else {
-        LOG_FATAL("DataRegistry: failed to load '" + name +
-                      "': unsupported int type with data size = "
-                  << data_size);
+        pending = deriving->second;
       }
-      out.data_ = std::make_shared<Table::RawData>();
-      out.data_->ptr = raw;
-    } else if (type_class == H5T_STRING) {
-      out.type_ = Table::kString;
-      std::string* strs = new std::string[n];
-      for (auto i = 0u; i < n; ++i) {
-        auto len = data_size;
-        auto c_str = reinterpret_cast<char*>(raw) + data_size * i;
-        for (auto p = c_str + len - 1; p != c_str && !*p; --p) --len;
-        strs[i].assign(c_str, len);
+    }
+  }
+  // load without blocking the readers of other tables
+  Table table;
+  if (pending.valid()) {
+    // rethrows the error of the deriving thread
+    table = pending.get();
+  } else if (derived.func) {
+    try {
+      table = Derive(name, derived);
+    } catch (...) {
+      {
+        std::lock_guard<CrashGuard::Mutex> lock(mutex_);
+        deriving_.erase(name);
       }
-      out.data_ = std::make_shared<Table::DataTmpl<std::string>>();
-      out.data_->ptr = strs;
-      free(raw);
-    } else {
-      LOG_FATAL("DataRegistry: '" << name << "' has data type of '"
-                                  << data_type.fromClass()
-                                  << "' which is not supported in openalpha");
+      promise->set_exception(std::current_exception());
+      throw;
     }
-    if (retain) array_map_[name] = out;
-    LOG_INFO("DataRegistry: " << name << " loaded");
-  } catch (H5::Exception& err) {
-    LOG_FATAL(
-        "DataRegistry: failed to load '" + name + "': " << err.getCDetailMsg());
+  } else {
+    table = Load(name);
   }
-  return out;
+  std::lock_guard<CrashGuard::Mutex> lock(mutex_);
+  auto& entry = array_map_[name];
+  entry.tick = ++tick_;
+  entry.retain |= retain;
+  if (entry.table) {
+    // loaded by the other thread meanwhile
+    stats_.hits++;
+  } else {
+    stats_.misses++;
+    entry.table = table;
+    stats_.bytes += entry.table.num_bytes_;
+    stats_.peak_bytes = std::max(stats_.peak_bytes, stats_.bytes);
+  }
+  if (promise) {
+    deriving_.erase(name);
+    promise->set_value(entry.table);
+  }
+  return entry.table;
+}
+
+void DataRegistry::Trim() {
+  if (!memory_limit_) return;
+  std::lock_guard<CrashGuard::Mutex> lock(mutex_);
+  // not retained first, then least recently used
+  std::vector<std::tuple<bool, int64_t, const std::string*>> candidates;
+  for (auto& pair : array_map_) {
+    auto& entry = pair.second;
+    if (entry.table.data_.use_count() > 1) continue;
+    candidates.emplace_back(entry.retain, entry.tick, &pair.first);
+  }
+  std::sort(candidates.begin(), candidates.end());
+  for (auto& c : candidates) {
+    if (stats_.bytes <= memory_limit_) break;
+    auto it = array_map_.find(*std::get<2>(c));
+    LOG_DEBUG("DataRegistry: " << it->first << " evicted");
+    stats_.bytes -= it->second.table.num_bytes_;
+    stats_.evictions++;
+    array_map_.erase(it);
+  }
+}
+
+DataRegistry::CacheStats DataRegistry::cache_stats() const {
+  std::lock_guard<CrashGuard::Mutex> lock(mutex_);
+  return stats_;
+}
+
+Table::MappedData::~MappedData() {
+  munmap(base, size);
+  ptr = nullptr;
+}
+
+Table::AllocatedData::AllocatedData(size_t size) : size(size) {
+  auto& memory = Memory::Instance();
+  // the first copy of a replicated table is on node 0
+  int node = Memory::kTables;
+  if (memory.placement() == Memory::kReplicate) node = 0;
+  ptr = memory.Allocate(size, node);
+}
+
+Table::AllocatedData::~AllocatedData() {
+  auto& memory = Memory::Instance();
+  memory.Free(ptr, size);
+  for (auto i = 1u; i < replicas.size(); ++i) memory.Free(replicas[i], size);
+  ptr = nullptr;
+}
+
+void Table::AllocatedData::Replicate() {
+  auto& memory = Memory::Instance();
+  if (memory.placement() != Memory::kReplicate) return;
+  replicas.push_back(ptr);
+  for (auto node = 1; node < memory.num_nodes(); ++node) {
+    replicas.push_back(memory.Allocate(size, node));
+    std::copy_n(reinterpret_cast<char*>(ptr), size,
+                reinterpret_cast<char*>(replicas.back()));
+  }
+}
+
+void Table::Prefetch(int num_rows) const {
+  auto irow = data_->last_row.exchange(-1) + 1;
+  if (!data_->mapped || irow <= 0) return;
+  auto n = std::min(num_rows, num_rows_ - irow);
+  if (n <= 0) return;
+  static const size_t kPageSize = sysconf(_SC_PAGESIZE);
+  auto row_size = num_bytes_ / num_rows_;
+  auto begin = reinterpret_cast<uintptr_t>(data_->ptr) + irow * row_size;
+  auto end = begin + n * row_size;
+  begin -= begin % kPageSize;
+  madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+  // fault the pages in, madvise only starts the read ahead
+  volatile char sink = 0;
+  for (auto p = begin; p < end; p += kPageSize) {
+    sink = sink + *reinterpret_cast<const char*>(p);
+  }
+}
+
+void DataRegistry::Prefetch() {
+  // only mapped tables have rows to fault in
+  if (!mmap_ || prefetch_rows_ <= 0) return;
+  std::lock_guard<std::mutex> lock(prefetch_mutex_);
+  if (!prefetch_thread_.joinable()) {
+    prefetch_thread_ = std::thread(&DataRegistry::PrefetchLoop, this);
+  }
+  prefetch_pending_ = true;
+  prefetch_cv_.notify_one();
+}
+
+void DataRegistry::StopPrefetch() {
+  {
+    std::lock_guard<std::mutex> lock(prefetch_mutex_);
+    if (!prefetch_thread_.joinable()) return;
+    prefetch_stop_ = true;
+    prefetch_cv_.notify_one();
+  }
+  prefetch_thread_.join();
+}
+
+void DataRegistry::PrefetchLoop() {
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(prefetch_mutex_);
+      prefetch_cv_.wait(lock,
+                        [this] { return prefetch_pending_ || prefetch_stop_; });
+      if (prefetch_stop_) return;
+      prefetch_pending_ = false;
+    }
+    // tables read on the previous date, held so that Trim() leaves them
+    std::vector<Table> tables;
+    {
+      std::lock_guard<CrashGuard::Mutex> lock(mutex_);
+      for (auto& pair : array_map_) {
+        if (pair.second.table.data_->last_row >= 0) {
+          tables.push_back(pair.second.table);
+        }
+      }
+    }
+    for (auto& table : tables) table.Prefetch(prefetch_rows_);
+  }
+}
+
+CrashGuard::Mutex& DataRegistry::hdf5_mutex() {
+  static CrashGuard::Mutex kMutex;
+  return kMutex;
+}
+
+uint64_t DataRegistry::version() const {
+  std::vector<std::tuple<std::string, uintmax_t, std::time_t>> files;
+  for (auto& entry : fs::directory_iterator(kDataPath)) {
+    auto& path = entry.path();
+    if (!Storage::IsData(path)) continue;
+    files.emplace_back(path.filename().string(), fs::file_size(path),
+                       fs::last_write_time(path));
+  }
+  std::sort(files.begin(), files.end());
+  auto h = Hash("");
+  for (auto& file : files) {
+    h = Hash(std::get<0>(file), h);
+    h = Hash(&std::get<1>(file), sizeof(std::get<1>(file)), h);
+    h = Hash(&std::get<2>(file), sizeof(std::get<2>(file)), h);
+  }
+  return h;
+}
+
+Table DataRegistry::Load(const std::string& name, fs::path path) {
+  if (path.empty()) path = Storage::Find(name);
+  // reported by the default backend
+  if (path.empty()) path = kDataPath / (name + ".h5");
+  auto storage = Storage::Get(path);
+  if (!storage) {
+    LOG_FATAL("DataRegistry: failed to load '" << name << "': unknown format '"
+                                               << path.extension() << "'");
+  }
+  return storage->Load(name, path.string(), mmap_);
 }
 
 bool DataRegistry::Has(const std::string& name) {
-  auto path = kDataPath / (name + ".h5");
-  return fs::exists(path);
+  {
+    std::lock_guard<CrashGuard::Mutex> lock(mutex_);
+    if (derived_.count(name)) return true;
+  }
+  return !Storage::Find(name).empty();
+}
+
+static void ReleaseTable(PyObject* capsule) {
+  delete reinterpret_cast<Table*>(PyCapsule_GetPointer(capsule, nullptr));
+}
+
+// numpy array owner holding a copy of the table, which pins it in the cache
+inline bp::object Owner(const Table& tbl) {
+  return bp::object(
+      bp::handle<>(PyCapsule_New(new Table(tbl), nullptr, ReleaseTable)));
 }
 
 template <typename T>
@@ -96,13 +260,18 @@ inline auto FromData(const Table& tbl) {
   return np::from_data(tbl.Data<void>(), np::dtype::get_builtin<T>(),
                        bp::make_tuple(tbl.num_rows(), tbl.num_columns()),
                        bp::make_tuple(tbl.num_columns() * sizeof(T), sizeof(T)),
-                       bp::object());
+                       Owner(tbl));
 }
 
 bp::object DataRegistry::GetDataPy(std::string name, bool retain) {
-  auto out = py_array_map_[name];
-  if (retain && out != bp::object{}) return out;
-  auto tbl = GetData(name, retain);
+  bp::object out;
+  Table tbl;
+  {
+    // the table may be derived by another thread, which takes the GIL to
+    // run a python derivation
+    PyInterpreter::Unlock unlock;
+    tbl = GetData(name, retain);
+  }
   switch (tbl.type_) {
     case Table::kDouble:
       out = FromData<double>(tbl);
@@ -122,21 +291,72 @@ bp::object DataRegistry::GetDataPy(std::string name, bool retain) {
     case Table::kInt8:
       out = FromData<int8_t>(tbl);
       break;
-    case Table::kString:
-      LOG_FATAL("DataRegistry: failed to load '" + name +
-                "': not support string array in python API yet");
+    case Table::kString: {
+      // zero-copy view of the fixed-width bytes, i.e. numpy dtype 'S<n>'
+      auto item_size = tbl.item_size();
+      out = np::from_data(
+          tbl.Bytes(), np::dtype(bp::str("S" + std::to_string(item_size))),
+          bp::make_tuple(tbl.num_rows(), tbl.num_columns()),
+          bp::make_tuple(tbl.num_columns() * item_size, item_size),
+          Owner(tbl));
       break;
+    }
     default:
       assert(0);
       break;
   }
-  if (retain) py_array_map_[name] = out;
   return out;
 }
 
+int DataRegistry::GetInstrumentIndex(const std::string& symbol) const {
+  auto it = symbol_index_.find(symbol);
+  if (it == symbol_index_.end()) return -1;
+  return it->second;
+}
+
+int DataRegistry::GetDateIndex(int64_t date) const {
+  auto end = dates_ + num_dates_;
+  auto it = std::lower_bound(dates_, end, date);
+  if (it == end || *it != date) return -1;
+  return it - dates_;
+}
+
+std::pair<int, int> DataRegistry::GetDateRange(int64_t start,
+                                               int64_t end) const {
+  auto di0 = std::lower_bound(dates_, dates_ + num_dates_, start) - dates_;
+  auto di1 = std::upper_bound(dates_, dates_ + num_dates_, end) - dates_;
+  return {di0, std::max(di0, di1)};
+}
+
+bp::tuple DataRegistry::GetDateRangePy(int64_t start, int64_t end) const {
+  auto range = GetDateRange(start, end);
+  return bp::make_tuple(range.first, range.second);
+}
+
 void DataRegistry::Initialize() {
-  GetData("symbol");
-  GetData("date");
+  auto& symbol = symbol_ = GetData("symbol");
+  symbol.Assert<std::string>();
+  auto symbols = symbol.Data<std::string>();
+  symbol_index_.reserve(symbol.num_rows());
+  for (auto ii = 0; ii < symbol.num_rows(); ++ii) {
+    auto& sym = symbols[ii * symbol.num_columns()];
+    if (!symbol_index_.emplace(sym, ii).second) {
+      LOG_WARN("DataRegistry: duplicate symbol '" << sym << "' at " << ii);
+    }
+  }
+
+  auto& date = date_ = GetData("date");
+  date.Assert<int64_t>();
+  if (date.num_columns() != 1) {
+    LOG_FATAL("DataRegistry: 'date' is expected to have one column");
+  }
+  dates_ = date.Data<int64_t>();
+  num_dates_ = date.num_rows();
+  for (auto di = 1; di < num_dates_; ++di) {
+    if (dates_[di] <= dates_[di - 1]) {
+      LOG_FATAL("DataRegistry: 'date' is not sorted at " << di);
+    }
+  }
 }
 
 }  // namespace openalpha
@@ -1,12 +1,22 @@
 #ifndef OPENALPHA_DATA_H_
 #define OPENALPHA_DATA_H_
 
+#include <atomic>
 #include <boost/type_index.hpp>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include <unordered_map>
 
 #include "common.h"
+#include "crash.h"
 #include "logger.h"
+#include "memory.h"
 #include "python.h"
 
 namespace openalpha {
@@ -68,7 +78,12 @@ class Table {
                                            << num_rows_ << " of '" << name_
                                            << "'");
     }
-    return reinterpret_cast<T*>(data_->ptr) + irow * num_columns_;
+    // for the prefetch of the following rows
+    data_->last_row.store(irow, std::memory_order_relaxed);
+    auto& replicas = data_->replicas;
+    auto ptr =
+        replicas.empty() ? data_->ptr : replicas[Memory::CurrentNode()];
+    return reinterpret_cast<T*>(ptr) + irow * num_columns_;
   }
 
   template <typename T>
@@ -87,12 +102,19 @@ class Table {
     return reinterpret_cast<T*>(data_->ptr);
   }
 
+  // raw fixed-width bytes of string table, item_size() bytes per item
+  const char* Bytes() const { return data_->bytes; }
+
   const std::string& name() const { return name_; }
   auto num_rows() const { return num_rows_; }
   auto num_columns() const { return num_columns_; }
   auto type() const { return type_; }
   auto type_name() const { return type_name_; }
+  auto item_size() const { return item_size_; }
+  auto num_bytes() const { return num_bytes_; }
   operator bool() const { return !!data_; }
+  // fault in num_rows rows after the last one read if mapped
+  void Prefetch(int num_rows) const;
 
  private:
   std::string name_;
@@ -100,11 +122,32 @@ class Table {
   int num_columns_;
   Type type_ = kUnknown;
   std::string type_name_;
+  int item_size_ = 0;
+  size_t num_bytes_ = 0;
   struct RawData {
     virtual ~RawData() {
-      if (ptr) free(ptr);
+      delete[] reinterpret_cast<char*>(ptr);
+      delete[] bytes;
     }
     void* ptr = nullptr;
+    char* bytes = nullptr;
+    bool mapped = false;
+    std::atomic<int> last_row{-1};
+    // copies per numa node read by Row(), the first is ptr
+    std::vector<void*> replicas;
+  };
+  // pages of Memory::Allocate
+  struct AllocatedData : RawData {
+    explicit AllocatedData(size_t size);
+    ~AllocatedData() override;
+    // copy to every node if the placement is kReplicate
+    void Replicate();
+    size_t size = 0;
+  };
+  struct MappedData : RawData {
+    ~MappedData() override;
+    void* base = nullptr;
+    size_t size = 0;
   };
   template <typename T>
   struct DataTmpl : RawData {
@@ -115,20 +158,149 @@ class Table {
   };
   std::shared_ptr<RawData> data_;
   friend class DataRegistry;
+  friend class Storage;
 };
 
+// Loaded tables are cached. A table is pinned while a Table copy or a numpy
+// array of it is alive outside of the cache, otherwise it can be evicted by
+// Trim() once the cache is over the memory limit, not retained and least
+// recently used first.
 class DataRegistry : public Singleton<DataRegistry> {
  public:
-  typedef std::unordered_map<std::string, Table> ArrayMap;
-  typedef std::unordered_map<std::string, bp::object> PyArrayMap;
+  struct CacheStats {
+    int64_t hits = 0;
+    int64_t misses = 0;
+    int64_t evictions = 0;
+    size_t bytes = 0;
+    size_t peak_bytes = 0;
+  };
+  // fills columns [ii0, ii1) of a derived field from the tables of its
+  // dependencies, out is row-major of the shape of the first one
+  typedef std::function<void(const std::vector<Table>& deps, int ii0,
+                             int ii1, double* out)>
+      DeriveFunc;
+  ~DataRegistry() { StopPrefetch(); }
   void Initialize();
   bool Has(const std::string& name);
+  // A derived field is served by GetData like a data file. It is computed
+  // on first use, on column blocks in parallel unless whole is set, and
+  // memoized in data/.derived/<name>.h5 until its dependencies or version
+  // change.
+  void Register(const std::string& name, const std::vector<std::string>& deps,
+                DeriveFunc func, const std::string& version = "",
+                bool whole = false);
+  // alpha library whose Initialize is run by the thread in the scope, kept
+  // loaded as long as the functions it registers
+  class LibraryScope {
+   public:
+    explicit LibraryScope(std::shared_ptr<void> library)
+        : prev_(std::move(kLibrary)) {
+      kLibrary = std::move(library);
+    }
+    ~LibraryScope() { kLibrary = std::move(prev_); }
+
+   private:
+    std::shared_ptr<void> prev_;
+    friend class DataRegistry;
+    inline static thread_local std::shared_ptr<void> kLibrary;
+  };
+  // tables not retained are evicted first when over the memory limit
   Table GetData(const std::string& name, bool retain = true);
   bp::object GetDataPy(std::string name, bool retain = true);
+  // evict unpinned tables until within the memory limit, pointers got from
+  // tables without holding them are invalid after this, even while another
+  // job of the daemon is calculating a date
+  void Trim();
+  // bytes of the cache, 0 for no limit
+  void set_memory_limit(size_t bytes) { memory_limit_ = bytes; }
+  CacheStats cache_stats() const;
+  // map contiguous uncompressed tables instead of reading them, so that
+  // rows are read from the file on first access
+  void set_mmap(bool on) { mmap_ = on; }
+  // rows read ahead by Prefetch() with mmap, 0 for no prefetch
+  void set_prefetch_rows(int n) { prefetch_rows_ = n; }
+  // called when a date starts, the background thread faults in the next
+  // rows of the cached mapped tables read on the previous date; it never
+  // loads a table, so it neither undoes Trim() nor runs derivations
+  void Prefetch();
+  void StopPrefetch();
+  // symbol -> ii, -1 if not found
+  int GetInstrumentIndex(const std::string& symbol) const;
+  // date -> di, -1 if not found
+  int GetDateIndex(int64_t date) const;
+  // [di0, di1) of dates within [start, end]
+  std::pair<int, int> GetDateRange(int64_t start, int64_t end) const;
+  bp::tuple GetDateRangePy(int64_t start, int64_t end) const;
+  int num_dates() const { return num_dates_; }
+  int num_instruments() const { return symbol_.num_rows(); }
+  const int64_t* dates() const { return dates_; }
+  // hash of the names, sizes and modification times of the data files,
+  // changed by any update of the data
+  uint64_t version() const;
+  // hash of the keys of the registered derived fields, changed by an update
+  // of their definitions or inputs
+  uint64_t DerivedVersion();
+  // the hdf5 library is not thread safe, held around any use of it
+  static CrashGuard::Mutex& hdf5_mutex();
 
  private:
-  ArrayMap array_map_;
-  PyArrayMap py_array_map_;
+  Table Load(const std::string& name, fs::path path = {});
+  struct Derived {
+    std::shared_ptr<void> library;  // destroyed after func
+    std::vector<std::string> deps;
+    DeriveFunc func;
+    std::string version;
+    bool whole = false;
+  };
+  // see derived.cc
+  uint64_t DerivedKey(const std::string& name, int depth = 0);
+  Table Derive(const std::string& name, const Derived& derived);
+  // marks a field as derived by the thread in Derive and its chunks, for
+  // GetData to tell a field depending on itself
+  class DerivingScope {
+   public:
+    explicit DerivingScope(const std::string& name) {
+      kDeriving.push_back(&name);
+    }
+    ~DerivingScope() { kDeriving.pop_back(); }
+    static bool Has(const std::string& name) {
+      for (auto p : kDeriving) {
+        if (*p == name) return true;
+      }
+      return false;
+    }
+
+   private:
+    inline static thread_local std::vector<const std::string*> kDeriving;
+  };
+  void PrefetchLoop();
+  struct Entry {
+    Table table;
+    bool retain = false;
+    int64_t tick = 0;
+  };
+  std::unordered_map<std::string, Entry> array_map_;
+  std::unordered_map<std::string, Derived> derived_;
+  // derived fields being computed, the threads other than the one
+  // computing a field wait for its table without holding any lock
+  std::unordered_map<std::string, std::shared_future<Table>> deriving_;
+  mutable CrashGuard::Mutex mutex_;
+  int64_t tick_ = 0;
+  size_t memory_limit_ = 0;
+  CacheStats stats_;
+  bool mmap_ = false;
+  int prefetch_rows_ = 0;
+  std::thread prefetch_thread_;
+  std::mutex prefetch_mutex_;
+  std::condition_variable prefetch_cv_;
+  bool prefetch_pending_ = false;
+  bool prefetch_stop_ = false;
+  std::unordered_map<std::string, int> symbol_index_;
+  // pinned for the whole run
+  Table symbol_;
+  Table date_;
+  const int64_t* dates_ = nullptr;
+  int num_dates_ = 0;
 };
 
 }  // namespace openalpha
@@ -0,0 +1,179 @@
+#include <H5Cpp.h>
+#include <algorithm>
+
+#include "data.h"
+#include "pool.h"
+#include "storage.h"
+
+namespace openalpha {
+
+// Derived fields are memoized in data/.derived/<name>.h5 with the key of
+// the definition as attribute. The key hashes the name and version of the
+// field and, recursively, the keys of the derived dependencies or the size
+// and modification time of the data files, so that an update of any input
+// recomputes it. The subdirectory keeps the memo out of version().
+
+static const H5std_string kDatasetName("default");
+static const char* kKeyName = "key";
+// least columns per call of the derive function
+static const int kBlockColumns = 64;
+
+static fs::path MemoPath(const std::string& name) {
+  return kDataPath / ".derived" / (name + ".h5");
+}
+
+// key of the memo file, 0 if missing or unreadable
+static uint64_t ReadMemoKey(const fs::path& path) {
+  if (!fs::exists(path)) return 0;
+  std::lock_guard<CrashGuard::Mutex> lock(DataRegistry::hdf5_mutex());
+  uint64_t key = 0;
+  try {
+    H5::H5File file(path.string(), H5F_ACC_RDONLY);
+    file.openDataSet(kDatasetName)
+        .openAttribute(kKeyName)
+        .read(H5::PredType::NATIVE_UINT64, &key);
+  } catch (H5::Exception& err) {
+    return 0;
+  }
+  return key;
+}
+
+static void WriteMemo(const fs::path& path, uint64_t key, const Table& tbl) {
+  std::lock_guard<CrashGuard::Mutex> lock(DataRegistry::hdf5_mutex());
+  auto tmp = path.string() + ".tmp";
+  try {
+    fs::create_directories(path.parent_path());
+    // contiguous, so that it can be mapped when loaded
+    hsize_t dims[2] = {hsize_t(tbl.num_rows()), hsize_t(tbl.num_columns())};
+    H5::H5File file(tmp, H5F_ACC_TRUNC);
+    auto dataset = file.createDataSet(
+        kDatasetName, H5::PredType::NATIVE_DOUBLE, H5::DataSpace(2, dims));
+    dataset.write(tbl.Data<double>(), H5::PredType::NATIVE_DOUBLE);
+    dataset.createAttribute(kKeyName, H5::PredType::NATIVE_UINT64,
+                            H5::DataSpace())
+        .write(H5::PredType::NATIVE_UINT64, &key);
+  } catch (H5::Exception& err) {
+    LOG_ERROR("DataRegistry: failed to write " << path << ": "
+                                               << err.getCDetailMsg());
+    fs::remove(tmp);
+    return;
+  }
+  fs::rename(tmp, path);
+}
+
+void DataRegistry::Register(const std::string& name,
+                            const std::vector<std::string>& deps,
+                            DeriveFunc func, const std::string& version,
+                            bool whole) {
+  if (deps.empty()) {
+    LOG_FATAL("DataRegistry: derived field '" << name << "' has no dependency");
+  }
+  if (!Storage::Find(name).empty()) {
+    LOG_FATAL("DataRegistry: derived field '" << name
+                                              << "' shadows the data file");
+  }
+  std::lock_guard<CrashGuard::Mutex> lock(mutex_);
+  auto it = derived_.find(name);
+  if (it != derived_.end()) {
+    // registered by every alpha using it
+    if (it->second.version == version && it->second.deps == deps) return;
+    LOG_WARN("DataRegistry: derived field '" << name << "' redefined");
+    auto entry = array_map_.find(name);
+    if (entry != array_map_.end()) {
+      stats_.bytes -= entry->second.table.num_bytes_;
+      array_map_.erase(entry);
+    }
+  }
+  auto& derived = derived_[name];
+  derived.deps = deps;
+  // the previous function is destroyed before its library is released
+  derived.func = std::move(func);
+  derived.library = LibraryScope::kLibrary;
+  derived.version = version;
+  derived.whole = whole;
+}
+
+uint64_t DataRegistry::DerivedKey(const std::string& name, int depth) {
+  if (depth > 64) {
+    LOG_FATAL("DataRegistry: derived field '" << name << "' depends on itself");
+  }
+  auto h = Hash(name);
+  Derived derived;
+  {
+    std::lock_guard<CrashGuard::Mutex> lock(mutex_);
+    auto it = derived_.find(name);
+    if (it != derived_.end()) derived = it->second;
+  }
+  if (!derived.func) {
+    auto path = Storage::Find(name);
+    if (path.empty()) return h;
+    auto size = fs::file_size(path);
+    auto mtime = fs::last_write_time(path);
+    h = Hash(&size, sizeof(size), h);
+    return Hash(&mtime, sizeof(mtime), h);
+  }
+  h = Hash(derived.version, h);
+  for (auto& dep : derived.deps) {
+    auto key = DerivedKey(dep, depth + 1);
+    h = Hash(&key, sizeof(key), h);
+  }
+  return h;
+}
+
+uint64_t DataRegistry::DerivedVersion() {
+  std::vector<std::string> names;
+  {
+    std::lock_guard<CrashGuard::Mutex> lock(mutex_);
+    for (auto& pair : derived_) names.push_back(pair.first);
+  }
+  std::sort(names.begin(), names.end());
+  auto h = Hash("");
+  for (auto& name : names) {
+    auto key = DerivedKey(name);
+    h = Hash(&key, sizeof(key), h);
+  }
+  return h;
+}
+
+Table DataRegistry::Derive(const std::string& name, const Derived& derived) {
+  DerivingScope scope(name);
+  auto key = DerivedKey(name);
+  auto path = MemoPath(name);
+  if (ReadMemoKey(path) == key) return Load(name, path);
+
+  std::vector<Table> deps;
+  for (auto& dep : derived.deps) deps.push_back(GetData(dep, false));
+  auto& first = deps[0];
+  Table out;
+  out.name_ = name;
+  out.num_rows_ = first.num_rows();
+  out.num_columns_ = first.num_columns();
+  out.type_ = Table::kDouble;
+  out.type_name_ = "double";
+  auto n = size_t(out.num_rows_) * out.num_columns_;
+  out.num_bytes_ = n * sizeof(double);
+  auto allocated = std::make_shared<Table::AllocatedData>(out.num_bytes_);
+  out.data_ = allocated;
+  auto raw = reinterpret_cast<double*>(allocated->ptr);
+  std::fill_n(raw, n, kNaN);
+  if (derived.whole) {
+    derived.func(deps, 0, out.num_columns_, raw);
+  } else {
+    // exclusive, as a chunk of another loop run while waiting could ask for
+    // this field, derived by this thread
+    TaskPool::Instance().ParallelFor(
+        0, out.num_columns_,
+        [&](int ii0, int ii1) {
+          DerivingScope scope(name);
+          derived.func(deps, ii0, ii1, raw);
+        },
+        kBlockColumns, true);
+  }
+  WriteMemo(path, key, out);
+  allocated->Replicate();
+  out.num_bytes_ *= std::max<size_t>(1, allocated->replicas.size());
+  LOG_INFO("DataRegistry: " << name << " derived");
+  return out;
+}
+
+}  // namespace openalpha
@@ -0,0 +1,286 @@
+#include "factor.h"
+
+#include <boost/algorithm/string.hpp>
+#include <cmath>
+#include <unordered_map>
+
+#include "logger.h"
+
+namespace openalpha {
+
+// in-place lower Cholesky factorization of k x k matrix a, a tiny ridge is
+// added on failure for collinear factors
+static bool Cholesky(std::vector<double>* a, int k) {
+  auto& m = *a;
+  auto trace = 0.;
+  for (auto i = 0; i < k; ++i) trace += m[i * k + i];
+  auto copy = m;
+  for (auto ridge : {0., 1e-10 * trace / k, 1e-6 * trace / k}) {
+    m = copy;
+    for (auto i = 0; i < k; ++i) m[i * k + i] += ridge;
+    auto ok = true;
+    for (auto j = 0; j < k && ok; ++j) {
+      auto d = m[j * k + j];
+      for (auto p = 0; p < j; ++p) d -= m[j * k + p] * m[j * k + p];
+      if (!(d > 0)) {
+        ok = false;
+        break;
+      }
+      d = std::sqrt(d);
+      m[j * k + j] = d;
+      for (auto i = j + 1; i < k; ++i) {
+        auto v = m[i * k + j];
+        for (auto p = 0; p < j; ++p) v -= m[i * k + p] * m[j * k + p];
+        m[i * k + j] = v / d;
+      }
+    }
+    if (ok) {
+      for (auto i = 0; i < k; ++i) {
+        for (auto j = i + 1; j < k; ++j) m[i * k + j] = 0;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+// L L' -= x x', x is destroyed
+static bool Downdate(double* l, double* x, int k) {
+  for (auto j = 0; j < k; ++j) {
+    auto d = l[j * k + j];
+    auto r2 = d * d - x[j] * x[j];
+    if (!(r2 > 1e-12 * d * d)) return false;
+    auto r = std::sqrt(r2);
+    auto c = r / d;
+    auto s = x[j] / d;
+    l[j * k + j] = r;
+    for (auto i = j + 1; i < k; ++i) {
+      l[i * k + j] = (l[i * k + j] - s * x[i]) / c;
+      x[i] = c * x[i] - s * l[i * k + j];
+    }
+  }
+  return true;
+}
+
+// solve L L' b = b in place
+static void Solve(const double* l, double* b, int k) {
+  for (auto i = 0; i < k; ++i) {
+    for (auto p = 0; p < i; ++p) b[i] -= l[i * k + p] * b[p];
+    b[i] /= l[i * k + i];
+  }
+  for (auto i = k - 1; i >= 0; --i) {
+    for (auto p = i + 1; p < k; ++p) b[i] -= l[p * k + i] * b[p];
+    b[i] /= l[i * k + i];
+  }
+}
+
+// demean rows of x (ni x k) and y within each group
+static void Demean(const FactorModel::Grouped& grouped, int k, double* x,
+                   double* y) {
+  std::vector<double> avg(k);
+  for (auto& pair : grouped) {
+    auto& members = pair.second;
+    if (members.empty()) continue;
+    std::fill(avg.begin(), avg.end(), 0.);
+    auto avg_y = 0.;
+    for (auto ii : members) {
+      for (auto j = 0; j < k; ++j) avg[j] += x[ii * k + j];
+      if (y) avg_y += y[ii];
+    }
+    for (auto& v : avg) v /= members.size();
+    avg_y /= members.size();
+    for (auto ii : members) {
+      for (auto j = 0; j < k; ++j) x[ii * k + j] -= avg[j];
+      if (y) y[ii] -= avg_y;
+    }
+  }
+}
+
+static void Gram(const FactorModel::Grouped& grouped, int k, const double* x,
+                 std::vector<double>* gram) {
+  gram->assign(k * k, 0.);
+  auto g = gram->data();
+  for (auto& pair : grouped) {
+    for (auto ii : pair.second) {
+      auto row = x + ii * k;
+      for (auto i = 0; i < k; ++i) {
+        for (auto j = 0; j <= i; ++j) g[i * k + j] += row[i] * row[j];
+      }
+    }
+  }
+  for (auto i = 0; i < k; ++i) {
+    for (auto j = i + 1; j < k; ++j) g[i * k + j] = g[j * k + i];
+  }
+}
+
+std::shared_ptr<FactorModel> FactorModel::Get(const std::string& spec,
+                                              const std::string& key) {
+  static std::mutex kMutex;
+  static std::unordered_map<std::string, std::shared_ptr<FactorModel>> kModels;
+  std::lock_guard<std::mutex> lock(kMutex);
+  auto& out = kModels[spec + "|" + key];
+  if (!out) out = std::make_shared<FactorModel>(spec);
+  return out;
+}
+
+FactorModel::FactorModel(const std::string& spec) {
+  std::vector<std::string> toks;
+  boost::split(toks, spec, boost::is_any_of(":"));
+  if (toks.size() < 2 || toks[0] != kNeutralizationByFactors) {
+    LOG_FATAL("FactorModel: invalid spec '"
+              << spec << "', expected 'factors:<field>,...[:<group>]'");
+  }
+  boost::split(fields_, toks[1], boost::is_any_of(", "),
+               boost::token_compress_on);
+  fields_.erase(std::remove(fields_.begin(), fields_.end(), ""),
+                fields_.end());
+  if (fields_.empty()) {
+    LOG_FATAL("FactorModel: no factor given in '" << spec << "'");
+  }
+  if (toks.size() > 2) group_ = toks[2];
+  // intercept is only needed without group dummies
+  k_ = fields_.size() + (group_.empty() ? 1 : 0);
+}
+
+std::shared_ptr<const FactorModel::Base> FactorModel::Update(
+    int di, const bool* valid) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (base_ && base_->di == di) return base_;
+  auto ni = dr_.GetData("symbol").num_rows();
+  auto base = std::make_shared<Base>();
+  base->di = di;
+  base->in.assign(ni, 0);
+  base->x.assign(ni * k_, kNaN);
+  auto offset = group_.empty() ? 1 : 0;
+  std::vector<const double*> rows;
+  for (auto& field : fields_) {
+    rows.push_back(dr_.GetData(field).Row<double>(di));
+  }
+  auto groups =
+      group_.empty() ? nullptr : dr_.GetData(group_).Row<int64_t>(di);
+  Grouped grouped;
+  for (auto ii = 0; ii < ni; ++ii) {
+    if (!valid[ii]) continue;
+    auto ig = groups ? groups[ii] : 0;
+    if (ig < 0) continue;
+    auto x = &base->x[ii * k_];
+    auto ok = true;
+    for (auto j = 0u; j < rows.size() && ok; ++j) {
+      x[j + offset] = rows[j][ii];
+      ok = std::isfinite(x[j + offset]);
+    }
+    if (!ok) continue;
+    if (offset) x[0] = 1;
+    base->in[ii] = 1;
+    base->n++;
+    grouped[ig].push_back(ii);
+  }
+  if (groups) {
+    for (auto& pair : grouped) {
+      if (pair.second.size() > 1) continue;
+      base->in[pair.second[0]] = 0;
+      base->n--;
+      pair.second.clear();
+    }
+    Demean(grouped, k_, base->x.data(), nullptr);
+  }
+  Gram(grouped, k_, base->x.data(), &base->chol);
+  if (!Cholesky(&base->chol, k_)) base->n = 0;
+  base_ = base;
+  return base_;
+}
+
+double FactorModel::Neutralize(int di, const bool* valid, Grouped* grouped,
+                               double* pos) {
+  auto base = Update(di, valid);
+  auto n = 0;
+  for (auto it = grouped->begin(); it != grouped->end();) {
+    auto& members = it->second;
+    auto end = std::remove_if(members.begin(), members.end(), [&](auto ii) {
+      if (base->in[ii]) return false;
+      pos[ii] = kNaN;
+      return true;
+    });
+    members.erase(end, members.end());
+    // as group neutralization, single instrument group can't be neutralized
+    if (!group_.empty() && members.size() == 1) {
+      pos[members[0]] = kNaN;
+      members.clear();
+    }
+    n += members.size();
+    if (members.empty()) {
+      it = grouped->erase(it);
+    } else {
+      ++it;
+    }
+  }
+  if (n <= k_ || base->n == 0) {
+    for (auto& pair : *grouped) {
+      for (auto ii : pair.second) pos[ii] = kNaN;
+    }
+    grouped->clear();
+    return 0;
+  }
+
+  const double* x = base->x.data();
+  std::vector<double> x2;
+  std::vector<double> chol;
+  if (n == base->n) {
+    chol = base->chol;
+  } else if (group_.empty() && (base->n - n) * 4 < base->n) {
+    // downdate the shared factorization with the instruments not held
+    chol = base->chol;
+    std::vector<char> held(base->in.size(), 0);
+    for (auto& pair : *grouped) {
+      for (auto ii : pair.second) held[ii] = 1;
+    }
+    std::vector<double> row(k_);
+    for (auto ii = 0u; ii < held.size() && !chol.empty(); ++ii) {
+      if (!base->in[ii] || held[ii]) continue;
+      std::copy(x + ii * k_, x + (ii + 1) * k_, row.begin());
+      if (!Downdate(chol.data(), row.data(), k_)) chol.clear();
+    }
+  }
+  if (chol.empty()) {
+    // group means depend on the instruments held, so recompute
+    if (!group_.empty()) {
+      x2 = base->x;
+      Demean(*grouped, k_, x2.data(), nullptr);
+      x = x2.data();
+    }
+    Gram(*grouped, k_, x, &chol);
+    if (!Cholesky(&chol, k_)) return 0;
+  }
+
+  if (!group_.empty()) {
+    // residual of group dummies, Frisch-Waugh-Lovell
+    for (auto& pair : *grouped) {
+      auto& members = pair.second;
+      auto avg = 0.;
+      for (auto ii : members) avg += pos[ii];
+      avg /= members.size();
+      for (auto ii : members) pos[ii] -= avg;
+    }
+  }
+  std::vector<double> b(k_, 0.);
+  for (auto& pair : *grouped) {
+    for (auto ii : pair.second) {
+      auto row = x + ii * k_;
+      for (auto j = 0; j < k_; ++j) b[j] += row[j] * pos[ii];
+    }
+  }
+  Solve(chol.data(), b.data(), k_);
+  auto sum = 0.;
+  for (auto& pair : *grouped) {
+    for (auto ii : pair.second) {
+      auto row = x + ii * k_;
+      auto v = pos[ii];
+      for (auto j = 0; j < k_; ++j) v -= row[j] * b[j];
+      pos[ii] = v;
+      sum += std::abs(v);
+    }
+  }
+  return sum;
+}
+
+}  // namespace openalpha
@@ -0,0 +1,56 @@
+#ifndef OPENALPHA_FACTOR_H_
+#define OPENALPHA_FACTOR_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "data.h"
+
+namespace openalpha {
+
+inline const std::string kNeutralizationByFactors = "factors";
+
+// Cross-sectional regression of alpha on factor exposures, e.g.
+// "factors:size,beta" or "factors:size,beta:industry" which adds industry
+// dummies. The Cholesky factorization of X'X over the universe is computed
+// once per date and shared by all alphas with the same spec and universe;
+// instruments an alpha does not hold are removed with rank-1 downdates.
+class FactorModel {
+ public:
+  typedef std::map<int64_t, std::vector<int>> Grouped;
+  // alphas with the same key share one model, the key should identify spec
+  // and the valid matrix
+  static std::shared_ptr<FactorModel> Get(const std::string& spec,
+                                          const std::string& key);
+  explicit FactorModel(const std::string& spec);
+  const std::string& group() const { return group_; }
+  // replace pos of the instruments in grouped with the residuals of the
+  // regression, instruments without exposures are removed from grouped,
+  // returns the sum of absolute residuals
+  double Neutralize(int di, const bool* valid, Grouped* grouped, double* pos);
+
+ private:
+  struct Base {
+    int di = -1;
+    int n = 0;                 // number of instruments in base set
+    std::vector<char> in;      // ii in base set
+    std::vector<double> x;     // exposures, ni x k, demeaned by group
+    std::vector<double> chol;  // lower Cholesky factor of X'X, k x k
+  };
+  std::shared_ptr<const Base> Update(int di, const bool* valid);
+
+ private:
+  DataRegistry& dr_ = DataRegistry::Instance();
+  std::vector<std::string> fields_;
+  std::string group_;
+  int k_ = 0;
+  std::shared_ptr<const Base> base_;
+  std::mutex mutex_;
+};
+
+}  // namespace openalpha
+
+#endif  // OPENALPHA_FACTOR_H_
@@ -0,0 +1,329 @@
+#include "interpreter.h"
+
+#include <map>
+
+#include "data.h"
+#include "logger.h"
+
+namespace openalpha {
+
+#if PY_VERSION_HEX >= 0x030C0000
+#define OPENALPHA_SUBINTERPRETERS
+#endif
+
+static PyThreadState* CurrentThreadState() {
+#if PY_VERSION_HEX >= 0x030D0000
+  return PyThreadState_GetUnchecked();
+#else
+  return _PyThreadState_UncheckedGet();
+#endif
+}
+
+PyInterpreter::Lock::Lock(PyInterpreter* interpreter)
+    : interpreter_(interpreter) {
+  saved_ = CurrentThreadState();
+  if (!interpreter_) {
+    // PyGILState_Ensure only knows the main thread state of the thread
+    if (saved_ == PyGILState_GetThisThreadState()) saved_ = nullptr;
+    if (saved_) PyEval_SaveThread();
+    state_ = PyGILState_Ensure();
+    return;
+  }
+  if (saved_) PyEval_SaveThread();
+  PyEval_RestoreThread(interpreter_->ThreadState());
+}
+
+PyInterpreter::Lock::~Lock() {
+  if (!interpreter_) {
+    PyGILState_Release(state_);
+  } else {
+    PyEval_SaveThread();
+  }
+  if (saved_) PyEval_RestoreThread(saved_);
+}
+
+PyInterpreter::Unlock::Unlock() : saved_(CurrentThreadState()) {
+  if (saved_) PyEval_SaveThread();
+}
+
+PyInterpreter::Unlock::~Unlock() {
+  if (saved_) PyEval_RestoreThread(saved_);
+}
+
+PyThreadState* PyInterpreter::ThreadState() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& state = states_[std::this_thread::get_id()];
+  if (!state) {
+    // the first thread state of a thread becomes the one of
+    // PyGILState_Ensure, which GilLock and Lock(nullptr) use to take the
+    // main interpreter, e.g. for a derived field defined in python, so a
+    // thread gets one of the main interpreter before one of this
+    if (!PyGILState_GetThisThreadState()) {
+      PyThreadState_New(PyInterpreterState_Main());
+    }
+    state = PyThreadState_New(interp_);
+  }
+  return state;
+}
+
+#ifdef OPENALPHA_SUBINTERPRETERS
+
+// buffer over memory of the engine, exposed as memoryview
+struct ViewObject {
+  PyObject_HEAD
+  void* ptr;
+  Py_ssize_t shape[2];
+  Py_ssize_t strides[2];
+  int ndim;
+  int item_size;
+  int readonly;
+  char format[16];
+  Table* table;
+};
+
+static void ViewDealloc(PyObject* self) {
+  auto view = reinterpret_cast<ViewObject*>(self);
+  delete view->table;
+  auto type = Py_TYPE(self);
+  type->tp_free(self);
+  Py_DECREF(type);
+}
+
+static int ViewGetBuffer(PyObject* self, Py_buffer* buffer, int flags) {
+  auto view = reinterpret_cast<ViewObject*>(self);
+  if ((flags & PyBUF_WRITABLE) && view->readonly) {
+    PyErr_SetString(PyExc_BufferError, "read-only view");
+    return -1;
+  }
+  buffer->buf = view->ptr;
+  buffer->obj = Py_NewRef(self);
+  buffer->len = view->item_size;
+  for (auto i = 0; i < view->ndim; ++i) buffer->len *= view->shape[i];
+  buffer->readonly = view->readonly;
+  buffer->itemsize = view->item_size;
+  buffer->format = (flags & PyBUF_FORMAT) ? view->format : nullptr;
+  buffer->ndim = view->ndim;
+  buffer->shape = (flags & PyBUF_ND) ? view->shape : nullptr;
+  buffer->strides =
+      (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? view->strides : nullptr;
+  buffer->suboffsets = nullptr;
+  buffer->internal = nullptr;
+  return 0;
+}
+
+static PyType_Slot kViewSlots[] = {
+    {Py_tp_dealloc, reinterpret_cast<void*>(ViewDealloc)},
+    {Py_bf_getbuffer, reinterpret_cast<void*>(ViewGetBuffer)},
+    {0, nullptr},
+};
+
+static PyType_Spec kViewSpec = {
+    "openalpha.View", sizeof(ViewObject), 0, Py_TPFLAGS_DEFAULT, kViewSlots,
+};
+
+static const char* kCapsuleName = "openalpha.interpreter";
+
+static PyInterpreter* FromModule(PyObject* module) {
+  auto capsule = PyObject_GetAttrString(module, "_interpreter");
+  if (!capsule) return nullptr;
+  auto out = PyCapsule_GetPointer(capsule, kCapsuleName);
+  Py_DECREF(capsule);
+  return reinterpret_cast<PyInterpreter*>(out);
+}
+
+// DataRegistry calls run without the GIL of the interpreter, a derived
+// field defined in python takes the one of the main interpreter
+static PyObject* GetData(PyObject* module, PyObject* args, PyObject* kwargs) {
+  static const char* kKeywords[] = {"name", "retain", nullptr};
+  const char* name;
+  int retain = 1;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|p",
+                                   const_cast<char**>(kKeywords), &name,
+                                   &retain)) {
+    return nullptr;
+  }
+  auto interpreter = FromModule(module);
+  if (!interpreter) return nullptr;
+  Table tbl;
+  std::string error;
+  Py_BEGIN_ALLOW_THREADS;
+  try {
+    FaultScope scope;
+    tbl = DataRegistry::Instance().GetData(name, retain);
+  } catch (const FatalError& err) {
+    error = err.what();
+  }
+  Py_END_ALLOW_THREADS;
+  if (error.size()) {
+    PyErr_SetString(PyExc_RuntimeError, error.c_str());
+    return nullptr;
+  }
+  std::string format;
+  switch (tbl.type()) {
+    case Table::kDouble:
+      format = "d";
+      break;
+    case Table::kFloat:
+      format = "f";
+      break;
+    case Table::kInt64:
+      format = "q";
+      break;
+    case Table::kInt32:
+      format = "i";
+      break;
+    case Table::kInt16:
+      format = "h";
+      break;
+    case Table::kInt8:
+      format = "b";
+      break;
+    case Table::kString:
+      format = std::to_string(tbl.item_size()) + "s";
+      break;
+    default:
+      PyErr_SetString(PyExc_RuntimeError, "unknown data type");
+      return nullptr;
+  }
+  auto ptr = tbl.type() == Table::kString
+                 ? const_cast<char*>(tbl.Bytes())
+                 : const_cast<char*>(tbl.Data<char>());
+  auto item_size =
+      tbl.type() == Table::kString
+          ? tbl.item_size()
+          : int(tbl.num_bytes() / std::max<size_t>(1, size_t(tbl.num_rows()) *
+                                                          tbl.num_columns()));
+  try {
+    auto out = interpreter->View(ptr, tbl.num_rows(), tbl.num_columns(),
+                                 format.c_str(), item_size, true, &tbl);
+    return bp::incref(out.ptr());
+  } catch (const bp::error_already_set& err) {
+    return nullptr;
+  }
+}
+
+static PyObject* GetDateIndex(PyObject* module, PyObject* arg) {
+  auto date = PyLong_AsLongLong(arg);
+  if (date == -1 && PyErr_Occurred()) return nullptr;
+  return PyLong_FromLong(DataRegistry::Instance().GetDateIndex(date));
+}
+
+static PyObject* GetInstrumentIndex(PyObject* module, PyObject* arg) {
+  auto symbol = PyUnicode_AsUTF8(arg);
+  if (!symbol) return nullptr;
+  return PyLong_FromLong(DataRegistry::Instance().GetInstrumentIndex(symbol));
+}
+
+static PyMethodDef kDrMethods[] = {
+    {"GetData", reinterpret_cast<PyCFunction>(GetData),
+     METH_VARARGS | METH_KEYWORDS, nullptr},
+    {"GetDateIndex", GetDateIndex, METH_O, nullptr},
+    {"GetInstrumentIndex", GetInstrumentIndex, METH_O, nullptr},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+PyInterpreter::PyInterpreter(const std::string& group) : group_(group) {
+  // created from the main interpreter
+  Lock main(nullptr);
+  auto saved = PyThreadState_Get();
+  PyInterpreterConfig config = {};
+  config.use_main_obmalloc = 0;
+  config.allow_fork = 0;
+  config.allow_exec = 0;
+  config.allow_threads = 1;
+  config.allow_daemon_threads = 0;
+  config.check_multi_interp_extensions = 1;
+  config.gil = PyInterpreterConfig_OWN_GIL;
+  PyThreadState* state = nullptr;
+  auto status = Py_NewInterpreterFromConfig(&state, &config);
+  if (PyStatus_Exception(status)) {
+    LOG_FATAL("PyInterpreter: failed to create interpreter '"
+              << group << "': " << (status.err_msg ? status.err_msg : ""));
+  }
+  interp_ = PyThreadState_GetInterpreter(state);
+  states_[std::this_thread::get_id()] = state;
+  view_type_ = PyType_FromSpec(&kViewSpec);
+  auto module = PyModule_New("dr");
+  PyModule_AddFunctions(module, kDrMethods);
+  PyModule_AddObject(module, "_interpreter",
+                     PyCapsule_New(this, kCapsuleName, nullptr));
+  dr_ = bp::object(bp::handle<>(module));
+  PyEval_SaveThread();
+  PyEval_RestoreThread(saved);
+  LOG_INFO("PyInterpreter: '" << group << "' created");
+}
+
+PyInterpreter::~PyInterpreter() {
+  Unlock unlock;
+  auto state = ThreadState();
+  PyEval_RestoreThread(state);
+  // None is immortal, so the member destructor may drop it without GIL
+  dr_ = bp::object();
+  Py_CLEAR(view_type_);
+  for (auto& pair : states_) {
+    if (pair.second == state) continue;
+    PyThreadState_Clear(pair.second);
+    PyThreadState_Delete(pair.second);
+  }
+  Py_EndInterpreter(state);
+}
+
+bp::object PyInterpreter::View(void* ptr, int rows, int columns,
+                               const char* format, int item_size,
+                               bool readonly, const Table* table) {
+  auto type = reinterpret_cast<PyTypeObject*>(view_type_);
+  auto view = reinterpret_cast<ViewObject*>(PyType_GenericAlloc(type, 0));
+  if (!view) bp::throw_error_already_set();
+  view->ptr = ptr;
+  view->ndim = rows < 0 ? 1 : 2;
+  view->shape[0] = rows < 0 ? columns : rows;
+  view->shape[1] = columns;
+  view->strides[0] = rows < 0 ? item_size : Py_ssize_t(columns) * item_size;
+  view->strides[1] = item_size;
+  view->item_size = item_size;
+  view->readonly = readonly;
+  snprintf(view->format, sizeof(view->format), "%s", format);
+  view->table = table ? new Table(*table) : nullptr;
+  auto obj = reinterpret_cast<PyObject*>(view);
+  auto out = PyMemoryView_FromObject(obj);
+  Py_DECREF(obj);
+  if (!out) bp::throw_error_already_set();
+  return bp::object(bp::handle<>(out));
+}
+
+std::shared_ptr<PyInterpreter> PyInterpreter::Get(const std::string& group) {
+  static std::mutex kMutex;
+  static std::map<std::string, std::weak_ptr<PyInterpreter>> kInterpreters;
+  std::lock_guard<std::mutex> lock(kMutex);
+  auto out = kInterpreters[group].lock();
+  if (!out) {
+    out.reset(new PyInterpreter(group));
+    kInterpreters[group] = out;
+  }
+  return out;
+}
+
+#else
+
+PyInterpreter::PyInterpreter(const std::string& group) : group_(group) {}
+
+PyInterpreter::~PyInterpreter() {}
+
+bp::object PyInterpreter::View(void* ptr, int rows, int columns,
+                               const char* format, int item_size,
+                               bool readonly, const Table* table) {
+  return bp::object();
+}
+
+std::shared_ptr<PyInterpreter> PyInterpreter::Get(const std::string& group) {
+  static std::once_flag kOnce;
+  std::call_once(kOnce, [] {
+    LOG_WARN("PyInterpreter: sub-interpreters need python 3.12+, "
+             "'interpreter' ignored");
+  });
+  return nullptr;
+}
+
+#endif
+
+}  // namespace openalpha
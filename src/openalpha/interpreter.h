@@ -0,0 +1,75 @@
+#ifndef OPENALPHA_INTERPRETER_H_
+#define OPENALPHA_INTERPRETER_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "python.h"
+
+namespace openalpha {
+
+class Table;
+
+// Sub-interpreter with its own GIL (Python 3.12+), shared by the python
+// alphas of the same 'interpreter' group, so that the alphas of different
+// groups run at the same time. Neither the openalpha module nor numpy (up
+// to 2.x) can be imported into it, so its alphas are plain python over
+// memoryviews: read-only 1-d/2-d ones of the tables and a writable row.
+class PyInterpreter {
+ public:
+  // the interpreter of the group, created on first use, null if not
+  // supported by the python built with
+  static std::shared_ptr<PyInterpreter> Get(const std::string& group);
+  ~PyInterpreter();
+  const std::string& group() const { return group_; }
+  // module with GetData(name, retain=True), GetDateIndex(date) and
+  // GetInstrumentIndex(symbol) of DataRegistry, under the lock
+  bp::object dr() const { return dr_; }
+  // memoryview of rows x columns items at ptr, 1-d if rows < 0, under the
+  // lock; a table copy, if given, is kept alive by the view
+  bp::object View(void* ptr, int rows, int columns, const char* format,
+                  int item_size, bool readonly, const Table* table = nullptr);
+
+  // holds the GIL of interpreter, or of the main interpreter if null,
+  // releasing the one held by the calling thread if any
+  class Lock {
+   public:
+    explicit Lock(PyInterpreter* interpreter);
+    ~Lock();
+
+   private:
+    PyInterpreter* interpreter_;
+    PyGILState_STATE state_;
+    PyThreadState* saved_ = nullptr;
+  };
+
+  // releases the GIL held by the calling thread, if any, in the scope
+  class Unlock {
+   public:
+    Unlock();
+    ~Unlock();
+
+   private:
+    PyThreadState* saved_ = nullptr;
+  };
+
+ private:
+  explicit PyInterpreter(const std::string& group);
+  PyThreadState* ThreadState();
+
+ private:
+  std::string group_;
+  PyInterpreterState* interp_ = nullptr;
+  std::mutex mutex_;
+  // one per thread entering the interpreter
+  std::unordered_map<std::thread::id, PyThreadState*> states_;
+  PyObject* view_type_ = nullptr;
+  bp::object dr_;
+};
+
+}  // namespace openalpha
+
+#endif  // OPENALPHA_INTERPRETER_H_
@@ -6,6 +6,10 @@
 #include <log4cxx/propertyconfigurator.h>
 #include <unistd.h>
 
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
 namespace openalpha {
 
 class Logger {
@@ -68,6 +72,24 @@ log4j.appender.sql.layout=org.apache.log4j.PatternLayout
 log4j.appender.sql.layout.ConversionPattern=%d{yyyy-MM-dd HH:mm:ss,SSS} %5p - %m%n
   )";
 
+// Thrown by LOG_FATAL inside a FaultScope instead of killing the process,
+// so that the failure of one alpha does not stop the others.
+class FatalError : public std::runtime_error {
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+// LOG_FATAL throws FatalError on this thread while a scope is alive
+class FaultScope {
+ public:
+  FaultScope() { ++depth_; }
+  ~FaultScope() { --depth_; }
+  static bool active() { return depth_ > 0; }
+
+ private:
+  inline static thread_local int depth_ = 0;
+};
+
 }  // namespace openalpha
 
 #define LOG_TRACE(msg) LOG4CXX_TRACE(openalpha::Logger::logger, msg)
@@ -77,7 +99,12 @@ log4j.appender.sql.layout.ConversionPattern=%d{yyyy-MM-dd HH:mm:ss,SSS} %5p - %m
 #define LOG_ERROR(msg) LOG4CXX_ERROR(openalpha::Logger::logger, msg)
 #define LOG_FATAL(msg)                                             \
   {                                                                \
-    LOG4CXX_FATAL(openalpha::Logger::logger, msg);                 \
+    std::ostringstream fatal_os;                                   \
+    fatal_os << msg;                                               \
+    LOG4CXX_FATAL(openalpha::Logger::logger, fatal_os.str());      \
+    if (openalpha::FaultScope::active()) {                         \
+      throw openalpha::FatalError(fatal_os.str());                 \
+    }                                                              \
     /* to-do: safe exit */                                         \
     if (system(("kill -9 " + std::to_string(getpid())).c_str())) { \
     }                                                              \
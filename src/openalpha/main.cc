@@ -1,5 +1,3 @@
-#include <dlfcn.h>
-#include <boost/algorithm/string.hpp>
 #include <boost/program_options.hpp>
 #include <boost/property_tree/ini_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
@@ -8,8 +6,12 @@
 
 #include "alpha.h"
 #include "common.h"
+#include "daemon.h"
 #include "data.h"
+#include "interpreter.h"
 #include "logger.h"
+#include "memory.h"
+#include "pool.h"
 #include "python.h"
 
 namespace bpo = boost::program_options;
@@ -18,6 +20,16 @@ int main(int argc, char *argv[]) {
   std::string config_file_path;
   std::string log_config_file_path;
   std::string data_path;
+  size_t data_memory_limit = 0;
+  bool data_mmap = false;
+  int prefetch_rows = 0;
+  std::string daemon_socket;
+  int num_workers = 0;
+  std::string submit_socket;
+  std::string huge_pages;
+  std::string numa;
+  bool pin_threads = false;
+  int num_threads = 0;
   try {
     bpo::options_description config("Configuration");
     config.add_options()("help,h", "produce help message")(
@@ -31,7 +43,31 @@ int main(int argc, char *argv[]) {
         "data_path,C",
         bpo::value<std::string>(&data_path)
             ->default_value(openalpha::kDataPath.string()),
-        "directory path where data files are located");
+        "directory path where data files are located")(
+        "data_memory_limit,M",
+        bpo::value<size_t>(&data_memory_limit)->default_value(0),
+        "MB of data tables kept in memory, 0 for no limit")(
+        "data_mmap", bpo::bool_switch(&data_mmap),
+        "map data files instead of reading them")(
+        "prefetch_rows", bpo::value<int>(&prefetch_rows)->default_value(2),
+        "rows of mapped data read ahead in background, 0 to disable")(
+        "daemon", bpo::value<std::string>(&daemon_socket),
+        "serve jobs on the given unix socket, keeping data loaded")(
+        "workers", bpo::value<int>(&num_workers)->default_value(4),
+        "number of jobs run at the same time by the daemon")(
+        "submit", bpo::value<std::string>(&submit_socket),
+        "submit the config file to the daemon on the given unix socket "
+        "and print the results")(
+        "huge_pages", bpo::value<std::string>(&huge_pages),
+        "huge pages of tables and alpha buffers: none, transparent or "
+        "explicit")("numa", bpo::value<std::string>(&numa),
+                    "numa placement of tables: local, interleave or "
+                    "replicate")(
+        "pin_threads", bpo::bool_switch(&pin_threads),
+        "pin threads to cpus and run alphas on their numa nodes")(
+        "threads", bpo::value<int>(&num_threads)->default_value(0),
+        "threads of the pool running parallel loops of the engine and "
+        "alphas, 0 for the number of cores");
 
     bpo::options_description config_file_options;
     config_file_options.add(config);
@@ -47,7 +83,7 @@ int main(int argc, char *argv[]) {
     std::ifstream ifs(config_file_path.c_str());
     if (ifs) {
       bpo::store(parse_config_file(ifs, config_file_options, true), vm);
-    } else {
+    } else if (!vm.count("daemon")) {
       std::cerr << config_file_path << " not found" << std::endl;
       return 1;
     }
@@ -59,6 +95,10 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  if (submit_socket.size()) {
+    return openalpha::Daemon::Submit(submit_socket, config_file_path);
+  }
+
   if (!std::ifstream(log_config_file_path.c_str()).good()) {
     std::ofstream(log_config_file_path)
         .write(openalpha::kDefaultLogConf, strlen(openalpha::kDefaultLogConf));
@@ -68,55 +108,30 @@ int main(int argc, char *argv[]) {
     openalpha::fs::create_directory(openalpha::kStorePath);
   openalpha::kDataPath = data_path;
   openalpha::Logger::Initialize("openalpha", log_config_file_path);
+  openalpha::Memory::Instance().Configure(huge_pages, numa, pin_threads);
+  openalpha::TaskPool::set_num_threads(num_threads);
   openalpha::InitalizePy();
-  openalpha::DataRegistry::Instance().Initialize();
+  auto &dr = openalpha::DataRegistry::Instance();
+  dr.set_memory_limit(data_memory_limit << 20);
+  dr.set_mmap(data_mmap);
+  dr.set_prefetch_rows(prefetch_rows);
+  dr.Initialize();
+
+  if (daemon_socket.size()) {
+    openalpha::Daemon(daemon_socket, num_workers).Run();
+    return 1;
+  }
 
   auto &ar = openalpha::AlphaRegistry::Instance();
   boost::property_tree::ptree prop_tree;
   boost::property_tree::ini_parser::read_ini(config_file_path, prop_tree);
-  for (auto &section : prop_tree) {
-    if (!section.second.size()) continue;
-    openalpha::Alpha::ParamMap params;
-    for (auto &item : section.second) {
-      auto name = item.first;
-      boost::to_lower(name);
-      params[name] = item.second.data();
-    }
-    auto path = params["alpha"];
-    if (!path.empty()) {
-      if (boost::algorithm::ends_with(path, ".py")) {
-        ar.Add((new openalpha::PyAlpha)
-                   ->Initialize(section.first, std::move(params)));
-      } else if (boost::algorithm::ends_with(path, ".so")) {
-        auto handle = dlopen(path.c_str(), RTLD_NOW);
-        if (!handle) {
-          LOG_FATAL("Alpha: failed to load '" << path + "': " << dlerror());
-        }
-        typedef openalpha::Alpha *(*CFunc)();
-        auto create_func = (CFunc)dlsym(handle, "create");
-        if (!create_func) {
-          LOG_FATAL("Alpha: failed to load '" << path + "': " << dlerror());
-        }
-        auto out = create_func();
-        auto alpha = dynamic_cast<openalpha::Alpha *>(out);
-        if (!alpha) {
-          LOG_FATAL("Alpha: failed to load '"
-                    << path + "', create() does not return Alpha object");
-        }
-        if (alpha->GetVersion() != openalpha::kApiVersion) {
-          LOG_FATAL("Alpah: failed to load '" << path + "': version mismatch, "
-                                              << "got " << alpha->GetVersion()
-                                              << ", expect "
-                                              << openalpha::kApiVersion);
-        }
-        ar.Add(alpha->Initialize(section.first, std::move(params)));
-      } else {
-        LOG_FATAL("Alpha: invalid path file '"
-                  << path << "', expected '.py' or '.so' file")
-      }
-    }
+  {
+    // the pool threads take the GIL when they run python, as in the daemon
+    openalpha::PyInterpreter::Unlock unlock;
+    ar.Load(prop_tree);
+    ar.Run();
   }
-  ar.Run();
+  dr.StopPrefetch();
 
   return 0;
 }
@@ -0,0 +1,145 @@
+#include "memory.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <atomic>
+#ifdef OPENALPHA_NUMA
+#include <numa.h>
+#endif
+
+#include "logger.h"
+
+namespace openalpha {
+
+static const size_t kHugePageSize = 2 << 20;
+
+void Memory::Configure(const std::string& huge_pages, const std::string& numa,
+                       bool pin_threads) {
+  if (huge_pages == "transparent") {
+    huge_pages_ = kTransparent;
+  } else if (huge_pages == "explicit") {
+    huge_pages_ = kExplicit;
+  } else if (huge_pages.size() && huge_pages != "none") {
+    LOG_FATAL("Memory: invalid huge_pages '" << huge_pages
+                                             << "', expected none, "
+                                                "transparent or explicit");
+  }
+  if (numa == "interleave") {
+    placement_ = kInterleave;
+  } else if (numa == "replicate") {
+    placement_ = kReplicate;
+  } else if (numa.size() && numa != "local") {
+    LOG_FATAL("Memory: invalid numa '"
+              << numa << "', expected local, interleave or replicate");
+  }
+  pin_threads_ = pin_threads;
+#ifdef OPENALPHA_NUMA
+  if (numa_available() >= 0) num_nodes_ = numa_max_node() + 1;
+#else
+  if (placement_ != kLocal) {
+    LOG_WARN("Memory: built without libnuma, numa=" << numa << " ignored");
+  }
+#endif
+  if (num_nodes_ == 1) placement_ = kLocal;
+  if (pin_threads_) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    std::vector<std::vector<int>> node_cpus(num_nodes_);
+    for (auto cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (!CPU_ISSET(cpu, &allowed)) continue;
+      auto node = 0;
+#ifdef OPENALPHA_NUMA
+      if (num_nodes_ > 1) node = std::max(0, numa_node_of_cpu(cpu));
+#endif
+      node_cpus[node].push_back(cpu);
+    }
+    // memory-only nodes have no cpu to pin to
+    for (auto& cpus : node_cpus) {
+      if (cpus.size()) node_cpus_.push_back(std::move(cpus));
+    }
+  }
+  static const char* kHugePages[] = {"none", "transparent", "explicit"};
+  static const char* kPlacements[] = {"local", "interleave", "replicate"};
+  LOG_INFO("Memory: huge_pages=" << kHugePages[huge_pages_]
+                                 << " numa=" << kPlacements[placement_]
+                                 << " nodes=" << num_nodes_
+                                 << " pin_threads=" << pin_threads_);
+}
+
+size_t Memory::Round(size_t bytes) const {
+  // the same length is given to munmap whether huge pages were got or not
+  if (huge_pages_ == kNoHugePages) return bytes;
+  return (bytes + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+}
+
+void* Memory::Allocate(size_t bytes, int node) {
+  if (!bytes) return nullptr;
+  auto size = Round(bytes);
+  void* ptr = MAP_FAILED;
+  if (huge_pages_ == kExplicit) {
+    ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    static std::atomic<bool> kWarned{false};
+    if (ptr == MAP_FAILED && !kWarned.exchange(true)) {
+      LOG_WARN("Memory: no huge page reserved, see vm.nr_hugepages");
+    }
+  }
+  if (ptr == MAP_FAILED) {
+    ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+      LOG_FATAL("Memory: failed to allocate " << bytes << " bytes");
+    }
+    if (huge_pages_ != kNoHugePages) madvise(ptr, size, MADV_HUGEPAGE);
+  }
+  // placed before the pages are touched
+#ifdef OPENALPHA_NUMA
+  if (num_nodes_ > 1) {
+    if (node >= 0) {
+      numa_tonode_memory(ptr, size, node);
+    } else if (node == kTables && placement_ == kInterleave) {
+      numa_interleave_memory(ptr, size, numa_all_nodes_ptr);
+    }
+  }
+#endif
+  return ptr;
+}
+
+void Memory::Free(void* ptr, size_t bytes) {
+  if (ptr) munmap(ptr, Round(bytes));
+}
+
+void Memory::RunOnNode(int node) {
+#ifdef OPENALPHA_NUMA
+  if (num_nodes_ > 1) numa_run_on_node(node);
+#endif
+  kNode = node;
+}
+
+void Memory::PinThread(int index) {
+  if (node_cpus_.empty()) return;
+  auto n = static_cast<int>(node_cpus_.size());
+  auto& cpus = node_cpus_[index % n];
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpus[index / n % cpus.size()], &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+    LOG_WARN("Memory: failed to pin thread " << index);
+    return;
+  }
+  kNode = FindNode();
+}
+
+int Memory::FindNode() {
+#ifdef OPENALPHA_NUMA
+  auto cpu = sched_getcpu();
+  if (cpu >= 0 && numa_available() >= 0) {
+    return std::max(0, numa_node_of_cpu(cpu));
+  }
+#endif
+  return 0;
+}
+
+}  // namespace openalpha
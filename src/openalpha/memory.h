@@ -0,0 +1,58 @@
+#ifndef OPENALPHA_MEMORY_H_
+#define OPENALPHA_MEMORY_H_
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+namespace openalpha {
+
+// Placement of data tables and alpha buffers, set by huge_pages, numa and
+// pin_threads in openalpha.conf. NUMA placement needs libnuma at build time
+// (OPENALPHA_NUMA), otherwise there is one node.
+class Memory : public Singleton<Memory> {
+ public:
+  enum HugePages { kNoHugePages, kTransparent, kExplicit };
+  // kLocal: first touch, kInterleave: pages of tables spread over the nodes,
+  // kReplicate: a copy of each table per node, read on the reader's node
+  enum Placement { kLocal, kInterleave, kReplicate };
+  // called before any thread is started, logs the policy
+  void Configure(const std::string& huge_pages, const std::string& numa,
+                 bool pin_threads);
+  // node of Allocate besides the node numbers
+  enum { kFirstTouch = -1, kTables = -2 };
+  // zeroed pages on node, kTables for the placement of tables
+  void* Allocate(size_t bytes, int node = kFirstTouch);
+  void Free(void* ptr, size_t bytes);
+  int num_nodes() const { return num_nodes_; }
+  Placement placement() const { return placement_; }
+  bool pin_threads() const { return pin_threads_; }
+  // pin the calling thread to the cpus of node
+  void RunOnNode(int node);
+  // pin pool thread index to one cpu, spreading the indexes round-robin
+  // over the nodes, then over the cpus of each node
+  void PinThread(int index);
+  // node of the calling thread, as of its last RunOnNode or first call
+  static int CurrentNode() {
+    if (kNode < 0) kNode = FindNode();
+    return kNode;
+  }
+
+ private:
+  static int FindNode();
+  size_t Round(size_t bytes) const;
+
+ private:
+  HugePages huge_pages_ = kNoHugePages;
+  Placement placement_ = kLocal;
+  bool pin_threads_ = false;
+  int num_nodes_ = 1;
+  // cpus the process may run on, by node, for pin_threads
+  std::vector<std::vector<int>> node_cpus_;
+  inline static thread_local int kNode = -1;
+};
+
+}  // namespace openalpha
+
+#endif  // OPENALPHA_MEMORY_H_
@@ -0,0 +1,124 @@
+#include "perf.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace openalpha {
+
+const char* PerfSeries::kHeader =
+    "date,pnl,ret,ir,dd,dd_start,dd_end,tvr,long,short,nlong,nshort,fitness,"
+    "cost,net_pnl,net_ret,net_ir,net_fitness";
+
+// ir and fitness of d daily returns of sum and sum of squares
+static void Ratios(double sum, double sum2, int d, double tvr, double* stddev,
+                   double* ir, double* fitness) {
+  auto avg = sum / d;
+  *stddev = 0;
+  if (d > 1) {
+    *stddev = std::sqrt(std::max(0., 1. / (d - 1) * (sum2 - sum * sum / d)));
+  }
+  *ir = *stddev > 0 ? avg / *stddev : 0;
+  auto sharp = *ir * std::sqrt(252);
+  *fitness = sharp * std::sqrt(std::abs(avg * 252) / tvr);
+}
+
+void PerfSeries::Add(int date, double ret, double pnl, double tvr,
+                     double long_pos, double short_pos, int64_t nlong,
+                     int64_t nshort, double cost, double net_ret) {
+  dates_.push_back(date);
+  ret_.push_back(ret_.back() + ret);
+  ret2_.push_back(ret2_.back() + ret * ret);
+  pnl_.push_back(pnl_.back() + pnl);
+  tvr_.push_back(tvr_.back() + tvr);
+  cost_.push_back(cost_.back() + cost);
+  net_ret_.push_back(net_ret_.back() + net_ret);
+  net_ret2_.push_back(net_ret2_.back() + net_ret * net_ret);
+  long_.push_back(long_.back() + long_pos);
+  short_.push_back(short_.back() + short_pos);
+  nlong_.push_back(nlong_.back() + nlong);
+  nshort_.push_back(nshort_.back() + nshort);
+  dd_sum_ += pnl;
+  if (dd_sum_ >= 0) dd_sum_ = 0;
+  dd_.push_back(dd_sum_);
+}
+
+std::pair<int, int> PerfSeries::Find(int date0, int date1) const {
+  int i0 = std::lower_bound(dates_.begin(), dates_.end(), date0) -
+           dates_.begin();
+  int i1 = std::upper_bound(dates_.begin(), dates_.end(), date1) -
+           dates_.begin();
+  return {i0, std::max(i0, i1)};
+}
+
+PerfSeries::Perf PerfSeries::Window(int i0, int i1, bool with_dd) const {
+  Perf out;
+  int d = i1 - i0;
+  if (d <= 0) return out;
+  out.date0 = dates_[i0];
+  out.date1 = dates_[i1 - 1];
+  out.days = d;
+  out.pnl = pnl_[i1] - pnl_[i0];
+  out.tvr = (tvr_[i1] - tvr_[i0]) / d;
+  out.ret = (ret_[i1] - ret_[i0]) / d;
+  Ratios(ret_[i1] - ret_[i0], ret2_[i1] - ret2_[i0], d, out.tvr, &out.stddev,
+         &out.ir, &out.fitness);
+  out.long_pos = (long_[i1] - long_[i0]) / d;
+  out.short_pos = (short_[i1] - short_[i0]) / d;
+  out.nlong = (nlong_[i1] - nlong_[i0]) / d;
+  out.nshort = (nshort_[i1] - nshort_[i0]) / d;
+  out.cost = cost_[i1] - cost_[i0];
+  out.net_pnl = out.pnl - out.cost;
+  out.net_ret = (net_ret_[i1] - net_ret_[i0]) / d;
+  auto net_stddev = 0.;
+  Ratios(net_ret_[i1] - net_ret_[i0], net_ret2_[i1] - net_ret2_[i0], d,
+         out.tvr, &net_stddev, &out.net_ir, &out.net_fitness);
+  if (!with_dd) return out;
+  auto dd_reset = true;
+  auto dd_sum = 0.;
+  auto dd_start = 0;
+  for (auto i = i0; i < i1; ++i) {
+    auto date = dates_[i];
+    if (dd_reset) {
+      dd_start = date;
+      dd_reset = false;
+    }
+    dd_sum += pnl_[i + 1] - pnl_[i];
+    if (dd_sum >= 0) {
+      dd_sum = 0;
+      dd_start = date;
+      dd_reset = true;
+    }
+    if (dd_sum < out.dd) {
+      out.dd = dd_sum;
+      out.dd_start = dd_start;
+      out.dd_end = date;
+    }
+  }
+  return out;
+}
+
+PerfSeries::Perf PerfSeries::Get(int date0, int date1) const {
+  auto range = Find(date0, date1);
+  return Window(range.first, range.second);
+}
+
+std::vector<PerfSeries::Perf> PerfSeries::Rolling(int n, int step) const {
+  std::vector<Perf> out;
+  if (n <= 0 || step <= 0) return out;
+  for (auto i1 = n; i1 <= size(); i1 += step) {
+    out.push_back(Window(i1 - n, i1, false));
+  }
+  return out;
+}
+
+void PerfSeries::Write(const std::string& label, const Perf& perf,
+                       std::ostream& os) {
+  os << label << ',' << perf.pnl << ',' << perf.ret << ',' << perf.ir << ','
+     << perf.dd << ',' << perf.dd_start << ',' << perf.dd_end << ','
+     << perf.tvr << ',' << perf.long_pos << ',' << perf.short_pos << ','
+     << perf.nlong << ',' << perf.nshort << ',' << perf.fitness << ','
+     << perf.cost << ',' << perf.net_pnl << ',' << perf.net_ret << ','
+     << perf.net_ir << ',' << perf.net_fitness;
+}
+
+}  // namespace openalpha
@@ -0,0 +1,83 @@
+#ifndef OPENALPHA_PERF_H_
+#define OPENALPHA_PERF_H_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace openalpha {
+
+// Prefix sums of the daily stats of an alpha, so that the performance of
+// any date range is answered in O(1), except drawdown which needs one scan
+// of the range, and rolling windows in O(number of windows).
+class PerfSeries {
+ public:
+  struct Perf {
+    int date0 = 0;
+    int date1 = 0;
+    int days = 0;
+    double pnl = 0;
+    double ret = 0;  // average daily return
+    double stddev = 0;
+    double ir = 0;
+    double dd = 0;
+    int dd_start = 0;
+    int dd_end = 0;
+    double tvr = 0;
+    double long_pos = 0;
+    double short_pos = 0;
+    int64_t nlong = 0;
+    int64_t nshort = 0;
+    double fitness = 0;
+    // after trading cost
+    double cost = 0;
+    double net_pnl = 0;
+    double net_ret = 0;
+    double net_ir = 0;
+    double net_fitness = 0;
+  };
+  static const char* kHeader;
+
+  // dates must be added in increasing order, net_ret is ret after cost
+  void Add(int date, double ret, double pnl, double tvr, double long_pos,
+           double short_pos, int64_t nlong, int64_t nshort, double cost,
+           double net_ret);
+  int size() const { return dates_.size(); }
+  int date(int i) const { return dates_[i]; }
+  // running drawdown of the whole series at i, from the last reset
+  double drawdown(int i) const { return dd_[i]; }
+  // daily return and turnover at i
+  double ret(int i) const { return ret_[i + 1] - ret_[i]; }
+  double tvr(int i) const { return tvr_[i + 1] - tvr_[i]; }
+  // [i0, i1) of dates in [date0, date1]
+  std::pair<int, int> Find(int date0, int date1) const;
+  // performance of [i0, i1)
+  Perf Window(int i0, int i1, bool with_dd = true) const;
+  Perf Get(int date0, int date1) const;
+  // windows of n days ending at every step-th day
+  std::vector<Perf> Rolling(int n, int step = 1) const;
+  // row of kHeader without the line end, so that columns can follow
+  static void Write(const std::string& label, const Perf& perf,
+                    std::ostream& os);
+
+ private:
+  std::vector<int> dates_;
+  // prefix sums with a leading zero
+  std::vector<double> ret_ = {0};
+  std::vector<double> ret2_ = {0};
+  std::vector<double> pnl_ = {0};
+  std::vector<double> tvr_ = {0};
+  std::vector<double> cost_ = {0};
+  std::vector<double> net_ret_ = {0};
+  std::vector<double> net_ret2_ = {0};
+  std::vector<double> long_ = {0};
+  std::vector<double> short_ = {0};
+  std::vector<int64_t> nlong_ = {0};
+  std::vector<int64_t> nshort_ = {0};
+  std::vector<double> dd_;
+  double dd_sum_ = 0;
+};
+
+}  // namespace openalpha
+
+#endif  // OPENALPHA_PERF_H_
@@ -0,0 +1,173 @@
+#include "pool.h"
+
+#include <algorithm>
+
+#include "crash.h"
+#include "logger.h"
+#include "memory.h"
+
+namespace openalpha {
+
+// state of a ParallelFor call, on the stack of the caller
+struct TaskPool::Loop {
+  const RangeFunc* func = nullptr;
+  int grain = 1;
+  bool isolated = false;
+  bool guarded = false;
+  bool exclusive = false;
+  std::atomic<int> pending{0};
+  std::atomic<bool> failed{false};
+  std::mutex mutex;
+  std::exception_ptr error;
+};
+
+TaskPool& TaskPool::Instance() {
+  static TaskPool kInstance(kNumThreads > 0
+                                ? kNumThreads
+                                : std::thread::hardware_concurrency());
+  return kInstance;
+}
+
+TaskPool::TaskPool(int num_threads) {
+  num_threads = std::max(1, num_threads);
+  for (auto i = 0; i < num_threads; ++i) {
+    queues_.emplace_back(new Queue);
+  }
+  for (auto i = 1; i < num_threads; ++i) {
+    threads_.emplace_back([this, i] { Worker(i); });
+  }
+  LOG_INFO("TaskPool: " << num_threads << " threads");
+}
+
+TaskPool::~TaskPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& thread : threads_) thread.join();
+}
+
+void TaskPool::ParallelFor(int begin, int end, const RangeFunc& func,
+                           int grain, bool exclusive) {
+  if (end <= begin) return;
+  if (grain <= 0) grain = std::max(1, (end - begin) / (8 * num_threads()));
+  if (num_threads() == 1 || end - begin <= grain) {
+    func(begin, end);
+    return;
+  }
+  Loop loop;
+  loop.func = &func;
+  loop.grain = grain;
+  loop.isolated = FaultScope::active();
+  loop.guarded = CrashGuard::active();
+  loop.exclusive = exclusive || kExclusive > 0;
+  loop.pending = 1;
+  Execute({&loop, begin, end});
+  // help with any chunk, of this loop or not unless exclusive, until all
+  // chunks are done
+  auto only = loop.exclusive ? &loop : nullptr;
+  while (loop.pending.load(std::memory_order_acquire) > 0) {
+    if (!RunOne(only)) std::this_thread::yield();
+  }
+  if (loop.error) std::rethrow_exception(loop.error);
+}
+
+void TaskPool::Execute(Task task) {
+  auto loop = task.loop;
+  std::unique_ptr<FaultScope> scope(loop->isolated ? new FaultScope : nullptr);
+  // undone on any exit, as the caller of ParallelFor leaves its frame once
+  // no chunk is pending
+  struct Done {
+    Loop* loop;
+    ~Done() {
+      kExclusive -= loop->exclusive;
+      loop->pending.fetch_sub(1, std::memory_order_release);
+    }
+  } done{loop};
+  kExclusive += loop->exclusive;
+  while (task.begin < task.end) {
+    // give away the upper half while other threads are idle
+    while (task.end - task.begin > loop->grain && num_idle_ > 0) {
+      auto mid = task.begin + (task.end - task.begin) / 2;
+      loop->pending.fetch_add(1);
+      {
+        auto& queue = *queues_[kQueue];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back({loop, mid, task.end});
+      }
+      num_tasks_++;
+      // not notified between the check and the wait of a worker
+      { std::lock_guard<std::mutex> lock(mutex_); }
+      cv_.notify_one();
+      task.end = mid;
+    }
+    // a grain at a time, so that the rest is split when a thread gets idle
+    auto end = std::min(task.end, task.begin + loop->grain);
+    try {
+      // a fault in a guarded chunk jumps back here, also on the calling
+      // thread, as the loop must be finished before its frame is left; one
+      // in a chunk not guarded kills the process, on any thread
+      if (loop->failed) {
+        // skipped
+      } else if (loop->guarded) {
+        CrashGuard::Run("TaskPool: chunk",
+                        [&] { (*loop->func)(task.begin, end); });
+      } else {
+        CrashGuard::Suspend suspend;
+        (*loop->func)(task.begin, end);
+      }
+    } catch (...) {
+      // the first error is rethrown by ParallelFor
+      std::lock_guard<std::mutex> lock(loop->mutex);
+      if (!loop->error) loop->error = std::current_exception();
+      loop->failed = true;
+    }
+    task.begin = end;
+  }
+}
+
+bool TaskPool::RunOne(const Loop* only) {
+  if (!num_tasks_) return false;
+  Task task;
+  // newest of the own deque first, then the oldest, i.e. largest, of others
+  auto n = queues_.size();
+  for (auto i = 0u; i < n && !task.loop; ++i) {
+    auto& queue = *queues_[(kQueue + i) % n];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) continue;
+    if (only) {
+      auto it = std::find_if(queue.tasks.begin(), queue.tasks.end(),
+                             [only](const Task& t) { return t.loop == only; });
+      if (it == queue.tasks.end()) continue;
+      task = *it;
+      queue.tasks.erase(it);
+    } else if (i == 0) {
+      task = queue.tasks.back();
+      queue.tasks.pop_back();
+    } else {
+      task = queue.tasks.front();
+      queue.tasks.pop_front();
+    }
+  }
+  if (!task.loop) return false;
+  num_tasks_--;
+  Execute(task);
+  return true;
+}
+
+void TaskPool::Worker(int index) {
+  kQueue = index;
+  auto& memory = Memory::Instance();
+  if (memory.pin_threads()) memory.PinThread(index);
+  for (;;) {
+    if (RunOne()) continue;
+    std::unique_lock<std::mutex> lock(mutex_);
+    num_idle_++;
+    cv_.wait(lock, [this] { return stop_ || num_tasks_ > 0; });
+    num_idle_--;
+    if (stop_) return;
+  }
+}
+
+}  // namespace openalpha
@@ -0,0 +1,121 @@
+#ifndef OPENALPHA_POOL_H_
+#define OPENALPHA_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace openalpha {
+
+// Fixed number of threads running submitted tasks in order of submission.
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads) {
+    for (auto i = 0; i < std::max(1, num_threads); ++i) {
+      threads_.emplace_back([this] { Loop(); });
+    }
+  }
+
+  // runs the queued tasks before returning
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) thread.join();
+  }
+
+  void Submit(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+  }
+
+ private:
+  void Loop() {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+        if (tasks_.empty()) return;
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  std::deque<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+};
+
+// Work-stealing pool shared by the engine and the alphas, so that parallel
+// loops of all of them add up to the number of threads. A loop is split in
+// halves while other threads are idle, down to its grain, the halves going
+// to the deque of the splitting thread, from which idle threads steal. The
+// calling thread runs chunks too, and any pending chunk while it waits.
+class TaskPool {
+ public:
+  typedef std::function<void(int, int)> RangeFunc;
+  // created on first use, with the number of threads set before
+  static TaskPool& Instance();
+  // 0 for the number of cores
+  static void set_num_threads(int n) { kNumThreads = n; }
+  int num_threads() const { return queues_.size(); }
+  // func(i0, i1) on chunks of [begin, end) of at least grain items, 0 for
+  // automatic, the first exception of a chunk is rethrown. An exclusive
+  // loop is waited for by running its own chunks only, and so are the loops
+  // nested in its chunks, for callers which must not run unrelated code
+  // meanwhile.
+  void ParallelFor(int begin, int end, const RangeFunc& func, int grain = 0,
+                   bool exclusive = false);
+  ~TaskPool();
+
+ private:
+  struct Loop;
+  struct Task {
+    Loop* loop = nullptr;
+    int begin = 0;
+    int end = 0;
+  };
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+  explicit TaskPool(int num_threads);
+  void Execute(Task task);
+  // a pending chunk, of loop only if given
+  bool RunOne(const Loop* only = nullptr);
+  void Worker(int index);
+
+ private:
+  // queues_[0] is shared by the threads out of the pool
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::atomic<int> num_idle_{0};
+  std::atomic<int> num_tasks_{0};
+  bool stop_ = false;
+  inline static int kNumThreads = 0;
+  inline static thread_local int kQueue = 0;
+  // depth of the chunks of exclusive loops run by the thread
+  inline static thread_local int kExclusive = 0;
+};
+
+}  // namespace openalpha
+
+#endif  // OPENALPHA_POOL_H_
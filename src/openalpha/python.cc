@@ -3,19 +3,162 @@
 #include <Python.h>
 #include <boost/filesystem.hpp>
 
+#include "alpha.h"
 #include "data.h"
 #include "logger.h"
 
 namespace openalpha {
 
+// rolling windows have no drawdown, see PerfSeries::Rolling
+static bp::dict ToDict(const PerfSeries::Perf& perf, bool with_dd = true) {
+  bp::dict out;
+  out["date0"] = perf.date0;
+  out["date1"] = perf.date1;
+  out["days"] = perf.days;
+  out["pnl"] = perf.pnl;
+  out["ret"] = perf.ret;
+  out["ir"] = perf.ir;
+  if (with_dd) {
+    out["dd"] = perf.dd;
+    out["dd_start"] = perf.dd_start;
+    out["dd_end"] = perf.dd_end;
+  }
+  out["tvr"] = perf.tvr;
+  out["long"] = perf.long_pos;
+  out["short"] = perf.short_pos;
+  out["nlong"] = perf.nlong;
+  out["nshort"] = perf.nshort;
+  out["fitness"] = perf.fitness;
+  out["cost"] = perf.cost;
+  out["net_pnl"] = perf.net_pnl;
+  out["net_ret"] = perf.net_ret;
+  out["net_ir"] = perf.net_ir;
+  out["net_fitness"] = perf.net_fitness;
+  return out;
+}
+
+// openalpha.ar stands for the registry of the job calling, see
+// AlphaRegistry::Current
+static bp::object GetPerf(const AlphaRegistry&, const std::string& name,
+                          int date0, int date1) {
+  auto alpha = AlphaRegistry::Current().Get(name);
+  if (!alpha) return {};
+  return ToDict(alpha->perf().Get(date0, date1));
+}
+
+static bp::object GetRollingPerf(const AlphaRegistry&,
+                                 const std::string& name, int n, int step) {
+  auto alpha = AlphaRegistry::Current().Get(name);
+  if (!alpha) return {};
+  bp::list out;
+  for (auto& perf : alpha->perf().Rolling(n, step)) {
+    out.append(ToDict(perf, false));
+  }
+  return out;
+}
+
+static bp::dict GetCacheStats(const DataRegistry& dr) {
+  auto stats = dr.cache_stats();
+  bp::dict out;
+  out["hits"] = stats.hits;
+  out["misses"] = stats.misses;
+  out["evictions"] = stats.evictions;
+  out["bytes"] = stats.bytes;
+  out["peak_bytes"] = stats.peak_bytes;
+  return out;
+}
+
+// func is called with the numpy arrays of deps and returns the derived
+// array, once for all columns
+static void Register(DataRegistry& dr, const std::string& name,
+                     bp::object deps, bp::object func,
+                     const std::string& version) {
+  std::vector<std::string> dep_names;
+  for (auto i = 0; i < bp::len(deps); ++i) {
+    dep_names.push_back(bp::extract<std::string>(deps[i]));
+  }
+  // the function may outlive the interpreter lock of this call
+  std::shared_ptr<bp::object> holder(new bp::object(func), [](auto p) {
+    GilLock lock;
+    delete p;
+  });
+  auto derive = [&dr, name, holder](const std::vector<Table>& tables, int ii0,
+                                    int ii1, double* out) {
+    GilLock lock;
+    try {
+      bp::list args;
+      for (auto& tbl : tables) args.append(dr.GetDataPy(tbl.name(), false));
+      auto arr = np::from_object((*holder)(*bp::tuple(args)),
+                                 np::dtype::get_builtin<double>(), 2, 2,
+                                 np::ndarray::C_CONTIGUOUS);
+      auto& first = tables[0];
+      if (arr.shape(0) != first.num_rows() ||
+          arr.shape(1) != first.num_columns()) {
+        LOG_FATAL("DataRegistry: derived field '"
+                  << name << "' has shape (" << arr.shape(0) << ", "
+                  << arr.shape(1) << "), expected (" << first.num_rows()
+                  << ", " << first.num_columns() << ")");
+      }
+      auto data = reinterpret_cast<const double*>(arr.get_data());
+      std::copy_n(data, size_t(first.num_rows()) * first.num_columns(), out);
+    } catch (const bp::error_already_set& err) {
+      PrintPyError("DataRegistry: failed to derive '" + name + "': ", true,
+                   true);
+    }
+  };
+  dr.Register(name, dep_names, derive, version, true);
+}
+
+// func(i0, i1) on chunks of [begin, end) in the TaskPool. The GIL is
+// released while waiting and each call holds it throughout, so chunks of
+// python code run one at a time; they overlap only inside numpy calls
+// which release the GIL, like ufuncs on large arrays.
+static void ParallelFor(int begin, int end, bp::object func, int grain) {
+  auto registry = &AlphaRegistry::Current();
+  auto run = [&func, registry](int i0, int i1) {
+    AlphaRegistry::Scope scope(registry);
+    GilLock lock;
+    try {
+      func(i0, i1);
+    } catch (const bp::error_already_set& err) {
+      PrintPyError("parallel_for: ", true, true);
+    }
+  };
+  auto state = PyEval_SaveThread();
+  try {
+    TaskPool::Instance().ParallelFor(begin, end, run, grain);
+  } catch (...) {
+    PyEval_RestoreThread(state);
+    throw;
+  }
+  PyEval_RestoreThread(state);
+}
+
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(DataRegistry_get_overloads,
                                        DataRegistry::GetDataPy, 1, 2)
 
 BOOST_PYTHON_MODULE(openalpha) {
-  bp::class_<DataRegistry>("DataRegistry", bp::no_init)
+  bp::class_<DataRegistry, boost::noncopyable>("DataRegistry", bp::no_init)
       .def("GetData", &DataRegistry::GetDataPy,
-           DataRegistry_get_overloads(bp::args("name", "retain")));
+           DataRegistry_get_overloads(bp::args("name", "retain")))
+      .def("GetInstrumentIndex", &DataRegistry::GetInstrumentIndex,
+           bp::args("symbol"))
+      .def("GetDateIndex", &DataRegistry::GetDateIndex, bp::args("date"))
+      .def("GetDateRange", &DataRegistry::GetDateRangePy,
+           bp::args("start", "end"))
+      .def("GetCacheStats", &GetCacheStats)
+      .def("Register", &Register,
+           (bp::arg("name"), bp::arg("deps"), bp::arg("func"),
+            bp::arg("version") = ""));
   bp::scope().attr("dr") = bp::ptr(&DataRegistry::Instance());
+  bp::class_<AlphaRegistry, boost::noncopyable>("AlphaRegistry", bp::no_init)
+      .def("GetPerf", &GetPerf, bp::args("name", "date0", "date1"))
+      .def("GetRollingPerf", &GetRollingPerf, bp::args("name", "n", "step"));
+  bp::scope().attr("ar") = bp::ptr(&AlphaRegistry::Instance());
+  // chunks are serialized by the GIL, see ParallelFor
+  bp::def("parallel_for", &ParallelFor,
+          (bp::arg("begin"), bp::arg("end"), bp::arg("func"),
+           bp::arg("grain") = 0));
 }
 
 #if PY_MAJOR_VERSION >= 3
@@ -18,6 +18,17 @@ inline void PrintPyError(const std::string& from, bool fatal = false,
 bp::object GetCallable(const bp::object& m, const char* name);
 inline bp::object kOpenAlpha;
 
+// holds the GIL of the main interpreter in the scope, for python calls from
+// any thread not holding the one of a sub-interpreter (see PyInterpreter)
+class GilLock {
+ public:
+  GilLock() : state_(PyGILState_Ensure()) {}
+  ~GilLock() { PyGILState_Release(state_); }
+
+ private:
+  PyGILState_STATE state_;
+};
+
 }  // namespace openalpha
 
 #endif  // OPENALPHA_PYTHON_H_
@@ -0,0 +1,127 @@
+#include <H5Cpp.h>
+#include <boost/algorithm/string.hpp>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+
+#include "alpha.h"
+
+namespace openalpha {
+
+// The raw alpha rows of a run are persisted in store/<alpha>/signal.h5,
+// keyed by what Generate depends on: the alpha file, the data, the derived
+// fields and the params other than those applied after Generate. A run with
+// the same key reads the rows instead of calling Generate.
+
+static const H5std_string kDatasetName("default");
+static const char* kKeyName = "key";
+static const char* kStartName = "start";
+// rows per chunk, compressed separately
+static const int kChunkRows = 16;
+
+// settings of Calculate, Record and Report which do not change the rows
+static bool IsSignalFree(const std::string& param) {
+  static const std::set<std::string> kParams = {
+      "decay", "max_stock_weight", "neutralization", "book_size", "cost",
+      "report", "batch", "calculate", "crash_guard", "signal_cache",
+      "interpreter"};
+  return kParams.count(param) || boost::starts_with(param, "prune_") ||
+         boost::starts_with(param, "bootstrap");
+}
+
+void Alpha::LoadSignal(uint64_t data_version) {
+  // combined rows depend on the other alphas
+  if (GetParam("signal_cache") != "true" || GetParam("combine").size()) return;
+  signal_key_ = SignalKey(data_version);
+  signal_cached_ = ReadSignal();
+}
+
+uint64_t Alpha::SignalKey(uint64_t data_version) const {
+  // the modules and libraries the alpha uses are not hashed, their changes
+  // are told by a signal_version param
+  auto path = GetParam("alpha");
+  std::ifstream is(path, std::ios::binary);
+  std::string content((std::istreambuf_iterator<char>(is)),
+                      std::istreambuf_iterator<char>());
+  auto h = Hash(content);
+  h = Hash(std::to_string(data_version), h);
+  std::map<std::string, std::string> params(params_.begin(), params_.end());
+  for (auto& pair : params) {
+    if (IsSignalFree(pair.first)) continue;
+    h = Hash(pair.first + "=" + pair.second + "\n", h);
+  }
+  // defaults of the params used by UpdateValid and Generate
+  for (auto v : {universe_, lookback_days_, delay_}) {
+    h = Hash(std::to_string(v) + "\n", h);
+  }
+  return h;
+}
+
+bool Alpha::ReadSignal() {
+  auto path = kStorePath / name_ / "signal.h5";
+  if (!fs::exists(path)) return false;
+  auto start = lookback_days_ + delay_;
+  auto num_rows = num_dates_ - 1 - start;
+  if (num_rows <= 0) return false;
+  std::lock_guard<CrashGuard::Mutex> lock(DataRegistry::hdf5_mutex());
+  try {
+    H5::H5File file(path.string(), H5F_ACC_RDONLY);
+    auto dataset = file.openDataSet(kDatasetName);
+    uint64_t key = 0;
+    int file_start = 0;
+    dataset.openAttribute(kKeyName).read(H5::PredType::NATIVE_UINT64, &key);
+    dataset.openAttribute(kStartName)
+        .read(H5::PredType::NATIVE_INT, &file_start);
+    hsize_t dims[2] = {};
+    dataset.getSpace().getSimpleExtentDims(dims, nullptr);
+    if (key != signal_key_ || file_start != start ||
+        dims[0] != hsize_t(num_rows) || dims[1] != hsize_t(num_instruments_)) {
+      return false;
+    }
+    // rows of alpha_ are contiguous
+    dataset.read(alpha_[start], H5::PredType::NATIVE_DOUBLE);
+  } catch (H5::Exception& err) {
+    LOG_WARN("Alpha: " << name_ << ": failed to read " << path << ": "
+                       << err.getCDetailMsg());
+    return false;
+  }
+  LOG_INFO("Alpha: " << name_ << ": signal read from " << path);
+  return true;
+}
+
+void Alpha::WriteSignal() {
+  auto start = lookback_days_ + delay_;
+  auto num_rows = num_dates_ - 1 - start;
+  if (num_rows <= 0 || !alpha_) return;
+  auto path = kStorePath / name_ / "signal.h5";
+  auto tmp = path.string() + ".tmp";
+  std::lock_guard<CrashGuard::Mutex> lock(DataRegistry::hdf5_mutex());
+  try {
+    hsize_t dims[2] = {hsize_t(num_rows), hsize_t(num_instruments_)};
+    hsize_t chunk[2] = {std::min<hsize_t>(kChunkRows, dims[0]),
+                        std::max<hsize_t>(1, dims[1])};
+    H5::DSetCreatPropList plist;
+    plist.setChunk(2, chunk);
+    plist.setDeflate(4);
+    H5::H5File file(tmp, H5F_ACC_TRUNC);
+    auto dataset = file.createDataSet(
+        kDatasetName, H5::PredType::NATIVE_DOUBLE, H5::DataSpace(2, dims),
+        plist);
+    dataset.write(alpha_[start], H5::PredType::NATIVE_DOUBLE);
+    H5::DataSpace scalar;
+    dataset.createAttribute(kKeyName, H5::PredType::NATIVE_UINT64, scalar)
+        .write(H5::PredType::NATIVE_UINT64, &signal_key_);
+    dataset.createAttribute(kStartName, H5::PredType::NATIVE_INT, scalar)
+        .write(H5::PredType::NATIVE_INT, &start);
+  } catch (H5::Exception& err) {
+    LOG_ERROR("Alpha: " << name_ << ": failed to write " << path << ": "
+                        << err.getCDetailMsg());
+    fs::remove(tmp);
+    return;
+  }
+  fs::rename(tmp, path);
+  LOG_INFO("Alpha: " << name_ << ": signal written to " << path);
+}
+
+}  // namespace openalpha
@@ -0,0 +1,195 @@
+#include "significance.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "pool.h"
+
+namespace openalpha {
+
+const char* Significance::kHeader =
+    ",ir_lo,ir_hi,fitness_lo,fitness_hi,p_value,dsr";
+
+void Philox::Refill() {
+  uint32_t k0 = key_[0], k1 = key_[1];
+  uint32_t c[4] = {counter_[0], counter_[1], counter_[2], counter_[3]};
+  for (auto round = 0; round < 10; ++round) {
+    auto p0 = uint64_t(0xD2511F53) * c[0];
+    auto p1 = uint64_t(0xCD9E8D57) * c[2];
+    uint32_t next[4] = {uint32_t(p1 >> 32) ^ c[1] ^ k0, uint32_t(p1),
+                        uint32_t(p0 >> 32) ^ c[3] ^ k1, uint32_t(p0)};
+    std::copy(next, next + 4, c);
+    k0 += 0x9E3779B9;
+    k1 += 0xBB67AE85;
+  }
+  std::copy(c, c + 4, out_);
+  if (!++counter_[2]) ++counter_[3];
+  used_ = 0;
+}
+
+SharpeTrials SharpeTrials::Of(const std::vector<double>& irs) {
+  SharpeTrials out;
+  out.num = irs.size();
+  if (out.num < 2) return out;
+  auto mean = 0.;
+  for (auto ir : irs) mean += ir;
+  mean /= out.num;
+  for (auto ir : irs) out.variance += (ir - mean) * (ir - mean);
+  out.variance /= out.num - 1;
+  return out;
+}
+
+static double NormalCdf(double x) { return 0.5 * std::erfc(-x / std::sqrt(2)); }
+
+// Newton from 0, monotone as the cdf is concave above 0
+static double NormalQuantile(double p) {
+  if (p < 0.5) return -NormalQuantile(1 - p);
+  auto x = 0.;
+  for (auto i = 0; i < 100; ++i) {
+    auto step = (NormalCdf(x) - p) * std::sqrt(2 * M_PI) * std::exp(x * x / 2);
+    x -= step;
+    if (std::abs(step) < 1e-12) break;
+  }
+  return x;
+}
+
+// as PerfSeries::Window
+static void Moments(double sum, double sum2, double sum_tvr, int n,
+                    double* ir, double* fitness) {
+  auto avg = sum / n;
+  auto stddev = std::sqrt(std::max(0., (sum2 - sum * sum / n) / (n - 1)));
+  *ir = stddev > 0 ? avg / stddev : 0;
+  *fitness =
+      *ir * std::sqrt(252) * std::sqrt(std::abs(avg * 252) / (sum_tvr / n));
+}
+
+// linear interpolation between the sorted values, NaN dropped
+static std::pair<double, double> Interval(std::vector<double> values,
+                                          double confidence) {
+  values.erase(std::remove_if(values.begin(), values.end(),
+                              [](double v) { return std::isnan(v); }),
+               values.end());
+  if (values.empty()) return {kNaN, kNaN};
+  std::sort(values.begin(), values.end());
+  auto quantile = [&values](double q) {
+    auto x = q * (values.size() - 1);
+    auto i = std::min<size_t>(x, values.size() - 1);
+    auto j = std::min(i + 1, values.size() - 1);
+    return values[i] + (x - i) * (values[j] - values[i]);
+  };
+  return {quantile((1 - confidence) / 2), quantile((1 + confidence) / 2)};
+}
+
+// sum of values with the signs of bits, branch free to be vectorized
+static inline double FlippedSum(const double* values, int n, uint32_t bits) {
+  auto out = 0.;
+  for (auto j = 0; j < n; ++j) {
+    out += values[j] * (double((bits >> j) & 1) * 2 - 1);
+  }
+  return out;
+}
+
+Significance Significance::Test(const PerfSeries& perf, int i0, int i1,
+                                int num_resamples, double block, uint64_t key,
+                                double confidence) {
+  Significance out;
+  int n = i1 - i0;
+  if (n < 2) return out;
+  std::vector<double> ret(n);
+  auto mean = 0.;
+  for (auto i = 0; i < n; ++i) {
+    ret[i] = perf.ret(i0 + i);
+    mean += ret[i];
+  }
+  auto sum = mean;
+  mean /= n;
+  double m2 = 0, m3 = 0, m4 = 0;
+  for (auto r : ret) {
+    auto d = r - mean;
+    m2 += d * d;
+    m3 += d * d * d;
+    m4 += d * d * d * d;
+  }
+  m2 /= n;
+  m3 /= n;
+  m4 /= n;
+  out.days = n;
+  if (m2 > 0) {
+    out.ir = mean / std::sqrt(m2 * n / (n - 1));
+    out.skew = m3 / std::pow(m2, 1.5);
+    out.kurt = m4 / (m2 * m2);
+  }
+  if (num_resamples <= 0) return out;
+
+  // circular prefix sums, a block of at most n days never wraps twice
+  std::vector<double> s1(2 * n + 1), s2(2 * n + 1), st(2 * n + 1);
+  for (auto i = 0; i < 2 * n; ++i) {
+    auto r = ret[i % n];
+    s1[i + 1] = s1[i] + r;
+    s2[i + 1] = s2[i] + r * r;
+    st[i + 1] = st[i] + perf.tvr(i0 + i % n);
+  }
+  if (block <= 0) block = std::cbrt(n);
+  block = std::min<double>(std::max(1., block), n);
+  // geometric block lengths of mean block
+  auto log_q = std::log1p(-1 / block);
+  for (auto date : {perf.date(i0), perf.date(i1 - 1)}) {
+    key = Hash(&date, sizeof(date), key);
+  }
+
+  std::vector<double> irs(num_resamples);
+  std::vector<double> fitness(num_resamples);
+  std::vector<char> exceeded(num_resamples);
+  TaskPool::Instance().ParallelFor(
+      0, num_resamples,
+      [&](int b0, int b1) {
+        for (auto b = b0; b < b1; ++b) {
+          // each block of the bootstrap costs O(1) from the prefix sums
+          Philox rng(key, 0, b);
+          double sum1 = 0, sum2 = 0, sum_tvr = 0;
+          for (auto m = 0; m < n;) {
+            auto s = std::min(n - 1, int(rng.Uniform() * n));
+            auto k = int(std::min<double>(
+                n - m, 1 + std::floor(std::log(rng.Uniform()) / log_q)));
+            sum1 += s1[s + k] - s1[s];
+            sum2 += s2[s + k] - s2[s];
+            sum_tvr += st[s + k] - st[s];
+            m += k;
+          }
+          Moments(sum1, sum2, sum_tvr, n, &irs[b], &fitness[b]);
+          Philox signs(key, 1, b);
+          auto flipped = 0.;
+          for (auto i = 0; i < n; i += 32) {
+            flipped += FlippedSum(&ret[i], std::min(32, n - i), signs());
+          }
+          exceeded[b] = flipped >= sum;
+        }
+      },
+      16);
+  std::tie(out.ir_lo, out.ir_hi) = Interval(irs, confidence);
+  std::tie(out.fitness_lo, out.fitness_hi) = Interval(fitness, confidence);
+  auto count = std::count(exceeded.begin(), exceeded.end(), 1);
+  out.p_value = (1. + count) / (1. + num_resamples);
+  return out;
+}
+
+void Significance::Deflate(const SharpeTrials& trials) {
+  if (days < 2) return;
+  static const double kEulerGamma = 0.5772156649015329;
+  auto ir0 = 0.;
+  if (trials.num > 1) {
+    ir0 = std::sqrt(trials.variance) *
+          ((1 - kEulerGamma) * NormalQuantile(1 - 1. / trials.num) +
+           kEulerGamma * NormalQuantile(1 - 1. / (trials.num * M_E)));
+  }
+  auto var = 1 - skew * ir + (kurt - 1) / 4 * ir * ir;
+  dsr = NormalCdf((ir - ir0) * std::sqrt(days - 1.) /
+                  std::sqrt(std::max(var, 1e-12)));
+}
+
+void Significance::Write(std::ostream& os) const {
+  os << ',' << ir_lo << ',' << ir_hi << ',' << fitness_lo << ','
+     << fitness_hi << ',' << p_value << ',' << dsr;
+}
+
+}  // namespace openalpha
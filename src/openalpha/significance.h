@@ -0,0 +1,76 @@
+#ifndef OPENALPHA_SIGNIFICANCE_H_
+#define OPENALPHA_SIGNIFICANCE_H_
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "common.h"
+#include "perf.h"
+
+namespace openalpha {
+
+// Philox4x32-10 counter-based generator: the words of a (key, counter) pair
+// are fixed, so resamples drawn on any thread in any order are the same.
+class Philox {
+ public:
+  // words of counters (index, stream, 0..)
+  Philox(uint64_t key, uint32_t stream, uint32_t index)
+      : key_{uint32_t(key), uint32_t(key >> 32)},
+        counter_{index, stream, 0, 0} {}
+  uint32_t operator()() {
+    if (used_ == 4) Refill();
+    return out_[used_++];
+  }
+  // in (0, 1)
+  double Uniform() { return ((*this)() + 0.5) * (1. / 4294967296.); }
+
+ private:
+  void Refill();
+  uint32_t key_[2];
+  uint32_t counter_[4];
+  uint32_t out_[4] = {};
+  int used_ = 4;
+};
+
+// Number of alphas tested together and the variance of their daily ir, which
+// deflate the ir of each of them.
+struct SharpeTrials {
+  int num = 0;
+  double variance = 0;
+  static SharpeTrials Of(const std::vector<double>& irs);
+};
+
+// Resampling tests of the daily returns of a window of a PerfSeries:
+// percentile intervals of ir and fitness from a stationary block bootstrap,
+// and the p-value of the mean return under random sign flips. NaN where not
+// computed.
+struct Significance {
+  static const char* kHeader;
+  double ir_lo = kNaN;
+  double ir_hi = kNaN;
+  double fitness_lo = kNaN;
+  double fitness_hi = kNaN;
+  double p_value = kNaN;
+  double dsr = kNaN;  // deflated sharpe ratio, see Deflate
+  // moments of the daily returns
+  int days = 0;
+  double ir = 0;
+  double skew = 0;
+  double kurt = 3;
+
+  // num_resamples of [i0, i1) with mean block of block days, 0 for the cube
+  // root of the number of days, drawn from key and the dates of the window
+  static Significance Test(const PerfSeries& perf, int i0, int i1,
+                           int num_resamples, double block, uint64_t key,
+                           double confidence = 0.95);
+  // probability that the true ir is above the expected maximum ir of
+  // trials.num alphas without skill (Bailey and Lopez de Prado, 2014)
+  void Deflate(const SharpeTrials& trials);
+  // columns after PerfSeries::Write
+  void Write(std::ostream& os) const;
+};
+
+}  // namespace openalpha
+
+#endif  // OPENALPHA_SIGNIFICANCE_H_
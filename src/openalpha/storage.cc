@@ -0,0 +1,183 @@
+#include "storage.h"
+
+#include <H5Cpp.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace openalpha {
+
+static const H5std_string kDatasetName("default");
+
+// 2d dataset "default" of HDF5 files
+class H5Storage : public Storage {
+ public:
+  std::vector<std::string> extensions() const override { return {".h5"}; }
+  Table Load(const std::string& name, const std::string& path,
+             bool map) override;
+};
+
+Table H5Storage::Load(const std::string& name, const std::string& path,
+                      bool map) {
+  std::lock_guard<CrashGuard::Mutex> lock(DataRegistry::hdf5_mutex());
+  Table out;
+  try {
+    H5::H5File file(H5std_string(path), H5F_ACC_RDONLY);
+    auto dataset = file.openDataSet(kDatasetName);
+    auto dataspace = dataset.getSpace();
+    hsize_t dims_out[2];
+    auto ndims = dataspace.getSimpleExtentDims(dims_out, nullptr);
+    if (ndims != 2) {
+      LOG_FATAL("DataRegistry: '" << name << "' is not 2d array");
+    }
+    auto n = dims_out[0] * dims_out[1];
+    auto data_type = dataset.getDataType();
+    auto type_class = data_type.getClass();
+    auto data_size = data_type.getSize();
+    auto num_bytes = n * data_size;
+    auto type = Table::kUnknown;
+    if (type_class == H5T_FLOAT) {
+      if (data_size == 4) {
+        type = Table::kFloat;
+      } else if (data_size == 8) {
+        type = Table::kDouble;
+      } else {
+        LOG_FATAL("DataRegistry: failed to load '" + name +
+                      "': unsupported double type with data size = "
+                  << data_size);
+      }
+    } else if (type_class == H5T_INTEGER) {
+      if (data_size == 1) {
+        type = Table::kInt8;
+      } else if (data_size == 2) {
+        type = Table::kInt16;
+      } else if (data_size == 4) {
+        type = Table::kInt32;
+      } else if (data_size == 8) {
+        type = Table::kInt64;
+      } else {
+        LOG_FATAL("DataRegistry: failed to load '" + name +
+                      "': unsupported int type with data size = "
+                  << data_size);
+      }
+    } else if (type_class == H5T_STRING) {
+      type = Table::kString;
+    } else {
+      LOG_FATAL("DataRegistry: '" << name << "' has data type of '"
+                                  << data_type.fromClass()
+                                  << "' which is not supported in openalpha");
+    }
+    SetShape(&out, name, dims_out[0], dims_out[1], type,
+             data_type.fromClass());
+    std::shared_ptr<MappedData> mapped;
+    if (map && type_class != H5T_STRING) {
+      auto plist = dataset.getCreatePlist();
+      auto offset = dataset.getOffset();
+      if (plist.getLayout() == H5D_CONTIGUOUS && !plist.getNfilters() &&
+          offset != HADDR_UNDEF) {
+        mapped = Map(path, offset, num_bytes);
+      }
+    }
+    if (mapped) {
+      SetData(&out, mapped, num_bytes);
+    } else if (type_class == H5T_STRING) {
+      auto bytes = new char[n * data_size]();
+      dataset.read(bytes, data_type);
+      SetStrings(&out, bytes, data_size);
+    } else {
+      auto allocated = std::make_shared<AllocatedData>(num_bytes);
+      dataset.read(allocated->ptr, data_type);
+      allocated->Replicate();
+      SetData(&out, allocated, num_bytes);
+    }
+    LOG_INFO("DataRegistry: " << name << (mapped ? " mapped" : " loaded"));
+  } catch (H5::Exception& err) {
+    LOG_FATAL(
+        "DataRegistry: failed to load '" + name + "': " << err.getCDetailMsg());
+  }
+  return out;
+}
+
+const std::vector<Storage*>& Storage::All() {
+  static const std::vector<Storage*> kAll = {
+#ifdef OPENALPHA_ARROW
+      NewArrowStorage(),
+#endif
+      new H5Storage,
+  };
+  return kAll;
+}
+
+Storage* Storage::Get(const fs::path& path) {
+  auto extension = path.extension().string();
+  for (auto storage : All()) {
+    for (auto& ext : storage->extensions()) {
+      if (ext == extension) return storage;
+    }
+  }
+  return nullptr;
+}
+
+fs::path Storage::Find(const std::string& name) {
+  for (auto storage : All()) {
+    for (auto& ext : storage->extensions()) {
+      auto path = kDataPath / (name + ext);
+      if (fs::exists(path)) return path;
+    }
+  }
+  return {};
+}
+
+std::shared_ptr<Storage::MappedData> Storage::Map(const std::string& path,
+                                                  size_t offset, size_t size) {
+  static const size_t kPageSize = sysconf(_SC_PAGESIZE);
+  auto fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return {};
+  auto start = offset - offset % kPageSize;
+  auto len = size + offset - start;
+  // private writable mapping, numpy arrays on it are writable
+  auto base =
+      mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, start);
+  close(fd);
+  if (base == MAP_FAILED) return {};
+  auto out = std::make_shared<MappedData>();
+  out->base = base;
+  out->size = len;
+  out->ptr = reinterpret_cast<char*>(base) + (offset - start);
+  out->mapped = true;
+  return out;
+}
+
+void Storage::SetShape(Table* out, const std::string& name, int num_rows,
+                       int num_columns, Table::Type type,
+                       const std::string& type_name) {
+  out->name_ = name;
+  out->num_rows_ = num_rows;
+  out->num_columns_ = num_columns;
+  out->type_ = type;
+  out->type_name_ = type_name;
+}
+
+void Storage::SetData(Table* out, std::shared_ptr<RawData> data,
+                      size_t num_bytes) {
+  out->num_bytes_ = num_bytes * std::max<size_t>(1, data->replicas.size());
+  out->data_ = data;
+}
+
+void Storage::SetStrings(Table* out, char* bytes, int item_size) {
+  auto n = size_t(out->num_rows_) * out->num_columns_;
+  out->item_size_ = item_size;
+  std::string* strs = new std::string[n];
+  for (auto i = 0u; i < n; ++i) {
+    size_t len = item_size;
+    auto c_str = bytes + item_size * i;
+    for (auto p = c_str + len - 1; p != c_str && !*p; --p) --len;
+    strs[i].assign(c_str, len);
+  }
+  out->num_bytes_ = n * item_size + n * sizeof(std::string);
+  out->data_ = std::make_shared<Table::DataTmpl<std::string>>();
+  out->data_->ptr = strs;
+  out->data_->bytes = bytes;
+}
+
+}  // namespace openalpha
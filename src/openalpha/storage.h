@@ -0,0 +1,59 @@
+#ifndef OPENALPHA_STORAGE_H_
+#define OPENALPHA_STORAGE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "data.h"
+
+namespace openalpha {
+
+// File format of the data tables, chosen per field by the extension of its
+// file, so that one data directory can mix formats.
+class Storage {
+ public:
+  virtual ~Storage() = default;
+  // with the dot, e.g. ".h5"
+  virtual std::vector<std::string> extensions() const = 0;
+  // the table in the file at path, with rows mapped from the file rather
+  // than read if map is set and the layout allows
+  virtual Table Load(const std::string& name, const std::string& path,
+                     bool map) = 0;
+  // built in backends, in order of preference for a field with several
+  // files
+  static const std::vector<Storage*>& All();
+  // backend of the extension of path, null if none
+  static Storage* Get(const fs::path& path);
+  // data file of the field, empty if none
+  static fs::path Find(const std::string& name);
+  // whether path is a data file of any backend
+  static bool IsData(const fs::path& path) { return !!Get(path); }
+
+ protected:
+  typedef Table::RawData RawData;
+  typedef Table::AllocatedData AllocatedData;
+  typedef Table::MappedData MappedData;
+  // private writable mapping of size bytes of the file at offset, null if
+  // it fails
+  static std::shared_ptr<MappedData> Map(const std::string& path,
+                                         size_t offset, size_t size);
+  // header of out, the data is set by SetData or SetStrings
+  static void SetShape(Table* out, const std::string& name, int num_rows,
+                       int num_columns, Table::Type type,
+                       const std::string& type_name);
+  // num_bytes counts the replicas of allocated data
+  static void SetData(Table* out, std::shared_ptr<RawData> data,
+                      size_t num_bytes);
+  // fixed-width bytes of item_size per string, owned by the table
+  static void SetStrings(Table* out, char* bytes, int item_size);
+};
+
+#ifdef OPENALPHA_ARROW
+// see arrow.cc
+Storage* NewArrowStorage();
+#endif
+
+}  // namespace openalpha
+
+#endif  // OPENALPHA_STORAGE_H_
@@ -0,0 +1,792 @@
+// openalpha-data: data preparation actions of scripts/data.py in C++.
+// Several actions given as -a a1,a2,... are chained on each file in one
+// read/write pass, e.g.
+//   openalpha-data -a ffill,nan2zero data/close.h5 data/adv60.h5
+//   openalpha-data -a par2h5 data/*.par
+//   openalpha-data -a toarrow data/*.h5
+//   openalpha-data -a validate data
+
+#include <H5Cpp.h>
+#include <omp.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef OPENALPHA_ARROW
+#include <arrow/api.h>
+#include <arrow/io/api.h>
+#include <arrow/ipc/api.h>
+#endif
+
+#ifdef OPENALPHA_PARQUET
+#include <parquet/arrow/reader.h>
+#include <parquet/arrow/writer.h>
+#endif
+
+namespace bpo = boost::program_options;
+namespace fs = boost::filesystem;
+
+namespace openalpha {
+
+static const H5std_string kDatasetName("default");
+// columns per block in the column-wise passes over row-major arrays, one
+// cache line of each row per block
+static const int kBlock = 64;
+
+// row-major date x instrument array
+struct Array {
+  enum Type { kDouble, kInt64, kString };
+  Type type = kDouble;
+  int num_rows = 0;
+  int num_columns = 0;
+  int item_size = sizeof(double);
+  // bytes per number in the source file, float32 and narrow integers are
+  // widened in memory and narrowed again when written
+  int width = 8;
+  bool is_unsigned = false;
+  std::vector<char> bytes;
+  template <typename T>
+  T* data() {
+    return reinterpret_cast<T*>(bytes.data());
+  }
+  void Resize(int rows, int columns, Type t, int size) {
+    num_rows = rows;
+    num_columns = columns;
+    type = t;
+    item_size = size;
+    bytes.assign(static_cast<size_t>(rows) * columns * size, 0);
+  }
+};
+
+static void Check(bool ok, const std::string& msg) {
+  if (!ok) throw std::runtime_error(msg);
+}
+
+static Array ReadH5(const std::string& path) {
+  Array out;
+  try {
+    H5::H5File file(path, H5F_ACC_RDONLY);
+    auto dataset = file.openDataSet(kDatasetName);
+    hsize_t dims[2];
+    auto ndims = dataset.getSpace().getSimpleExtentDims(dims, nullptr);
+    Check(ndims == 2, path + " is not 2d array");
+    auto data_type = dataset.getDataType();
+    auto type_class = data_type.getClass();
+    if (type_class == H5T_FLOAT) {
+      out.Resize(dims[0], dims[1], Array::kDouble, sizeof(double));
+      out.width = data_type.getSize();
+      dataset.read(out.bytes.data(), H5::PredType::NATIVE_DOUBLE);
+    } else if (type_class == H5T_INTEGER) {
+      out.Resize(dims[0], dims[1], Array::kInt64, sizeof(int64_t));
+      out.width = data_type.getSize();
+      out.is_unsigned = dataset.getIntType().getSign() == H5T_SGN_NONE;
+      dataset.read(out.bytes.data(), H5::PredType::NATIVE_INT64);
+    } else if (type_class == H5T_STRING) {
+      out.Resize(dims[0], dims[1], Array::kString, data_type.getSize());
+      dataset.read(out.bytes.data(), data_type);
+    } else {
+      Check(false, path + " has unsupported data type");
+    }
+  } catch (H5::Exception& err) {
+    Check(false, "failed to read " + path + ": " + err.getCDetailMsg());
+  }
+  return out;
+}
+
+static const H5::PredType& IntType(int width, bool is_unsigned) {
+  switch (width) {
+    case 1:
+      return is_unsigned ? H5::PredType::NATIVE_UINT8
+                         : H5::PredType::NATIVE_INT8;
+    case 2:
+      return is_unsigned ? H5::PredType::NATIVE_UINT16
+                         : H5::PredType::NATIVE_INT16;
+    case 4:
+      return is_unsigned ? H5::PredType::NATIVE_UINT32
+                         : H5::PredType::NATIVE_INT32;
+    default:
+      return is_unsigned ? H5::PredType::NATIVE_UINT64
+                         : H5::PredType::NATIVE_INT64;
+  }
+}
+
+static void WriteH5(const std::string& path, Array& arr) {
+  // write aside and rename so that a failed write keeps the input
+  auto tmp = path + ".tmp";
+  try {
+    H5::H5File file(tmp, H5F_ACC_TRUNC);
+    hsize_t dims[2] = {hsize_t(arr.num_rows), hsize_t(arr.num_columns)};
+    H5::DataSpace space(2, dims);
+    // hdf5 converts to the type of the source file
+    if (arr.type == Array::kDouble) {
+      auto& file_type = arr.width == 4 ? H5::PredType::NATIVE_FLOAT
+                                       : H5::PredType::NATIVE_DOUBLE;
+      file.createDataSet(kDatasetName, file_type, space)
+          .write(arr.bytes.data(), H5::PredType::NATIVE_DOUBLE);
+    } else if (arr.type == Array::kInt64) {
+      file.createDataSet(kDatasetName, IntType(arr.width, arr.is_unsigned),
+                         space)
+          .write(arr.bytes.data(), H5::PredType::NATIVE_INT64);
+    } else {
+      H5::StrType str_type(H5::PredType::C_S1, arr.item_size);
+      str_type.setStrpad(H5T_STR_NULLPAD);
+      file.createDataSet(kDatasetName, str_type, space)
+          .write(arr.bytes.data(), str_type);
+    }
+  } catch (H5::Exception& err) {
+    Check(false, "failed to write " + path + ": " + err.getCDetailMsg());
+  }
+  fs::rename(tmp, path);
+}
+
+#ifdef OPENALPHA_ARROW
+// table of one column per instrument, as written by scripts/data.py and
+// pandas
+static Array FromColumns(const std::string& path,
+                         std::shared_ptr<arrow::Table> table) {
+  auto status = table->CombineChunks().Value(&table);
+  Check(status.ok(), "failed to read " + path + ": " + status.ToString());
+  // pandas may store the index as the last column
+  auto num_columns = table->num_columns();
+  auto schema = table->schema();
+  if (num_columns > 1 &&
+      schema->field(num_columns - 1)->name() == "__index_level_0__") {
+    --num_columns;
+  }
+  Array out;
+  auto n = table->num_rows();
+  auto type = table->column(0)->type()->id();
+  if (type == arrow::Type::STRING) {
+    auto size = 1;
+    for (auto j = 0; j < num_columns; ++j) {
+      auto col = std::static_pointer_cast<arrow::StringArray>(
+          table->column(j)->chunk(0));
+      for (auto i = 0; i < n; ++i) size = std::max(size, col->value_length(i));
+    }
+    out.Resize(n, num_columns, Array::kString, size);
+  } else if (type == arrow::Type::INT64 || type == arrow::Type::INT32) {
+    out.Resize(n, num_columns, Array::kInt64, sizeof(int64_t));
+  } else {
+    out.Resize(n, num_columns, Array::kDouble, sizeof(double));
+  }
+  if (type == arrow::Type::INT32 || type == arrow::Type::FLOAT) out.width = 4;
+  auto status2 = arrow::Status::OK();
+#pragma omp parallel for
+  for (auto j = 0; j < num_columns; ++j) {
+    auto chunk = table->column(j)->chunk(0);
+    auto id = chunk->type_id();
+    if (id != type) {
+#pragma omp critical
+      status2 = arrow::Status::TypeError("mixed column types");
+      continue;
+    }
+    for (auto i = 0; i < n; ++i) {
+      auto k = static_cast<size_t>(i) * num_columns + j;
+      auto null = chunk->IsNull(i);
+      if (id == arrow::Type::STRING) {
+        auto v = std::static_pointer_cast<arrow::StringArray>(chunk)->Value(i);
+        memcpy(&out.bytes[k * out.item_size], v.data(), v.size());
+      } else if (id == arrow::Type::INT64) {
+        out.data<int64_t>()[k] =
+            null ? 0
+                 : std::static_pointer_cast<arrow::Int64Array>(chunk)->Value(i);
+      } else if (id == arrow::Type::INT32) {
+        out.data<int64_t>()[k] =
+            null ? 0
+                 : std::static_pointer_cast<arrow::Int32Array>(chunk)->Value(i);
+      } else if (id == arrow::Type::DOUBLE) {
+        out.data<double>()[k] =
+            null ? std::nan("")
+                 : std::static_pointer_cast<arrow::DoubleArray>(chunk)->Value(
+                       i);
+      } else if (id == arrow::Type::FLOAT) {
+        out.data<double>()[k] =
+            null ? std::nan("")
+                 : std::static_pointer_cast<arrow::FloatArray>(chunk)->Value(i);
+      } else {
+#pragma omp critical
+        status2 = arrow::Status::TypeError(chunk->type()->ToString());
+        break;
+      }
+    }
+  }
+  Check(status2.ok(), path + " has unsupported type " + status2.message());
+  return out;
+}
+
+// arrow ipc files of one fixed_size_list column holding the rows, as read
+// by openalpha, or of one column per instrument
+static Array ReadArrow(const std::string& path) {
+  auto infile = arrow::io::ReadableFile::Open(path);
+  Check(infile.ok(), "failed to open " + path);
+  auto reader = arrow::ipc::RecordBatchFileReader::Open(*infile);
+  Check(reader.ok(), "failed to read " + path + ": " +
+                         reader.status().ToString());
+  std::vector<std::shared_ptr<arrow::RecordBatch>> batches;
+  for (auto i = 0; i < (*reader)->num_record_batches(); ++i) {
+    auto batch = (*reader)->ReadRecordBatch(i);
+    Check(batch.ok(), "failed to read " + path + ": " +
+                          batch.status().ToString());
+    batches.push_back(*batch);
+  }
+  auto schema = (*reader)->schema();
+  auto table = arrow::Table::FromRecordBatches(schema, batches);
+  Check(table.ok(), "failed to read " + path + ": " +
+                        table.status().ToString());
+  if (schema->num_fields() != 1 ||
+      schema->field(0)->type()->id() != arrow::Type::FIXED_SIZE_LIST) {
+    return FromColumns(path, *table);
+  }
+  auto& list_type =
+      static_cast<const arrow::FixedSizeListType&>(*schema->field(0)->type());
+  auto num_columns = list_type.list_size();
+  auto type = list_type.value_type()->id();
+  int64_t n = 0;
+  for (auto& batch : batches) n += batch->num_rows();
+  Array out;
+  if (type == arrow::Type::FIXED_SIZE_BINARY) {
+    auto& binary_type = static_cast<const arrow::FixedSizeBinaryType&>(
+        *list_type.value_type());
+    out.Resize(n, num_columns, Array::kString, binary_type.byte_width());
+  } else if (type == arrow::Type::INT64 || type == arrow::Type::INT32) {
+    out.Resize(n, num_columns, Array::kInt64, sizeof(int64_t));
+  } else if (type == arrow::Type::DOUBLE || type == arrow::Type::FLOAT) {
+    out.Resize(n, num_columns, Array::kDouble, sizeof(double));
+  } else {
+    Check(false, path + " has unsupported type " +
+                     list_type.value_type()->ToString());
+  }
+  if (type == arrow::Type::INT32 || type == arrow::Type::FLOAT) out.width = 4;
+  size_t k = 0;
+  for (auto& batch : batches) {
+    auto& list =
+        static_cast<const arrow::FixedSizeListArray&>(*batch->column(0));
+    auto values = list.values();
+    auto i0 = list.value_offset(0);
+    auto m = batch->num_rows() * num_columns;
+    for (auto i = i0; i < i0 + m; ++i, ++k) {
+      auto null = values->IsNull(i);
+      if (type == arrow::Type::FIXED_SIZE_BINARY) {
+        auto& binary = static_cast<const arrow::FixedSizeBinaryArray&>(*values);
+        if (!null) {
+          memcpy(&out.bytes[k * out.item_size], binary.GetValue(i),
+                 out.item_size);
+        }
+      } else if (type == arrow::Type::INT64) {
+        out.data<int64_t>()[k] =
+            null ? 0 : static_cast<const arrow::Int64Array&>(*values).Value(i);
+      } else if (type == arrow::Type::INT32) {
+        out.data<int64_t>()[k] =
+            null ? 0 : static_cast<const arrow::Int32Array&>(*values).Value(i);
+      } else if (type == arrow::Type::DOUBLE) {
+        out.data<double>()[k] =
+            null ? std::nan("")
+                 : static_cast<const arrow::DoubleArray&>(*values).Value(i);
+      } else {
+        out.data<double>()[k] =
+            null ? std::nan("")
+                 : static_cast<const arrow::FloatArray&>(*values).Value(i);
+      }
+    }
+  }
+  return out;
+}
+
+template <typename From, typename To>
+static std::shared_ptr<arrow::Buffer> Narrow(const Array& arr) {
+  auto n = arr.bytes.size() / sizeof(From);
+  auto buffer = arrow::AllocateBuffer(n * sizeof(To));
+  Check(buffer.ok(), buffer.status().ToString());
+  auto in = reinterpret_cast<const From*>(arr.bytes.data());
+  auto out = reinterpret_cast<To*>((*buffer)->mutable_data());
+  for (size_t k = 0; k < n; ++k) out[k] = static_cast<To>(in[k]);
+  return std::move(*buffer);
+}
+
+// items of arr in the arrow type of the width of the source file, signed as
+// openalpha reads signed integers only
+static std::shared_ptr<arrow::Buffer> ArrowItems(
+    const Array& arr, std::shared_ptr<arrow::DataType>* type) {
+  if (arr.type == Array::kDouble && arr.width == 4) {
+    *type = arrow::float32();
+    return Narrow<double, float>(arr);
+  }
+  if (arr.type == Array::kInt64 && arr.width < 8) {
+    switch (arr.width) {
+      case 1:
+        *type = arrow::int8();
+        return Narrow<int64_t, int8_t>(arr);
+      case 2:
+        *type = arrow::int16();
+        return Narrow<int64_t, int16_t>(arr);
+      default:
+        *type = arrow::int32();
+        return Narrow<int64_t, int32_t>(arr);
+    }
+  }
+  if (arr.type == Array::kDouble) {
+    *type = arrow::float64();
+  } else if (arr.type == Array::kInt64) {
+    *type = arrow::int64();
+  } else {
+    *type = arrow::fixed_size_binary(arr.item_size);
+  }
+  return std::make_shared<arrow::Buffer>(
+      reinterpret_cast<const uint8_t*>(arr.bytes.data()), arr.bytes.size());
+}
+
+// one uncompressed record batch, which openalpha maps without copy
+static void WriteArrow(const std::string& path, Array& arr) {
+  std::shared_ptr<arrow::DataType> type;
+  auto buffer = ArrowItems(arr, &type);
+  auto n = int64_t(arr.num_rows) * arr.num_columns;
+  auto values = arrow::MakeArray(arrow::ArrayData::Make(
+      type, n, {nullptr, buffer}, 0));
+  auto list = arrow::FixedSizeListArray::FromArrays(values, arr.num_columns);
+  Check(list.ok(), "failed to write " + path + ": " +
+                       list.status().ToString());
+  auto schema =
+      arrow::schema({arrow::field("default", (*list)->type(), false)});
+  auto batch = arrow::RecordBatch::Make(schema, arr.num_rows, {*list});
+  auto tmp = path + ".tmp";
+  auto outfile = arrow::io::FileOutputStream::Open(tmp);
+  Check(outfile.ok(), "failed to open " + tmp);
+  auto writer = arrow::ipc::MakeFileWriter(*outfile, schema);
+  auto status = writer.status();
+  if (status.ok()) status = (*writer)->WriteRecordBatch(*batch);
+  if (status.ok()) status = (*writer)->Close();
+  if (status.ok()) status = (*outfile)->Close();
+  Check(status.ok(), "failed to write " + path + ": " + status.ToString());
+  fs::rename(tmp, path);
+}
+#endif
+
+#ifdef OPENALPHA_PARQUET
+// parquet files written by scripts/data.py hold one column per instrument
+static Array ReadParquet(const std::string& path) {
+  auto infile = arrow::io::ReadableFile::Open(path);
+  Check(infile.ok(), "failed to open " + path);
+  std::unique_ptr<parquet::arrow::FileReader> reader;
+  std::shared_ptr<arrow::Table> table;
+  auto status = parquet::arrow::OpenFile(*infile, arrow::default_memory_pool(),
+                                         &reader);
+  if (status.ok()) status = reader->ReadTable(&table);
+  Check(status.ok(), "failed to read " + path + ": " + status.ToString());
+  return FromColumns(path, table);
+}
+
+// column j of arr in the type of Builder
+template <typename Builder, typename T>
+static arrow::Status BuildColumn(Array& arr, int j,
+                                 std::shared_ptr<arrow::Array>* out) {
+  Builder builder;
+  auto status = builder.Reserve(arr.num_rows);
+  if (!status.ok()) return status;
+  for (auto i = 0; i < arr.num_rows; ++i) {
+    builder.UnsafeAppend(arr.data<T>()[size_t(i) * arr.num_columns + j]);
+  }
+  return builder.Finish(out);
+}
+
+static void WriteParquet(const std::string& path, Array& arr) {
+  Check(arr.type != Array::kString, "can't write strings to " + path);
+  std::vector<std::shared_ptr<arrow::Field>> fields(arr.num_columns);
+  std::vector<std::shared_ptr<arrow::Array>> columns(arr.num_columns);
+  auto status = arrow::Status::OK();
+  // float32 and narrow integers as float32 and int32, read back by
+  // FromColumns
+  for (auto j = 0; j < arr.num_columns && status.ok(); ++j) {
+    if (arr.type == Array::kDouble) {
+      status = arr.width == 4
+                   ? BuildColumn<arrow::FloatBuilder, double>(arr, j,
+                                                              &columns[j])
+                   : BuildColumn<arrow::DoubleBuilder, double>(arr, j,
+                                                               &columns[j]);
+    } else {
+      status = arr.width < 8
+                   ? BuildColumn<arrow::Int32Builder, int64_t>(arr, j,
+                                                               &columns[j])
+                   : BuildColumn<arrow::Int64Builder, int64_t>(arr, j,
+                                                               &columns[j]);
+    }
+    if (status.ok()) {
+      fields[j] = arrow::field(std::to_string(j), columns[j]->type());
+    }
+  }
+  Check(status.ok(), "failed to write " + path + ": " + status.ToString());
+  auto table = arrow::Table::Make(arrow::schema(fields), columns);
+  auto tmp = path + ".tmp";
+  auto outfile = arrow::io::FileOutputStream::Open(tmp);
+  Check(outfile.ok(), "failed to open " + tmp);
+  auto props = parquet::WriterProperties::Builder()
+                   .compression(parquet::Compression::SNAPPY)
+                   ->build();
+  status = parquet::arrow::WriteTable(*table, arrow::default_memory_pool(),
+                                      *outfile, 1 << 20, props);
+  if (status.ok()) status = (*outfile)->Close();
+  Check(status.ok(), "failed to write " + path + ": " + status.ToString());
+  fs::rename(tmp, path);
+}
+#endif
+
+static bool IsParquet(const std::string& path) {
+  return fs::path(path).extension() == ".par";
+}
+
+static bool IsArrow(const std::string& path) {
+  auto ext = fs::path(path).extension();
+  return ext == ".arrow" || ext == ".feather";
+}
+
+static Array Read(const std::string& path) {
+  if (IsArrow(path)) {
+#ifdef OPENALPHA_ARROW
+    return ReadArrow(path);
+#else
+    Check(false, "can't read " + path + ": built without arrow support");
+#endif
+  }
+  if (!IsParquet(path)) return ReadH5(path);
+#ifdef OPENALPHA_PARQUET
+  return ReadParquet(path);
+#else
+  Check(false, "can't read " + path + ": built without parquet support");
+  return {};
+#endif
+}
+
+static void Write(const std::string& path, Array& arr) {
+  if (IsArrow(path)) {
+#ifdef OPENALPHA_ARROW
+    return WriteArrow(path, arr);
+#else
+    Check(false, "can't write " + path + ": built without arrow support");
+#endif
+  }
+  if (!IsParquet(path)) return WriteH5(path, arr);
+#ifdef OPENALPHA_PARQUET
+  WriteParquet(path, arr);
+#else
+  Check(false, "can't write " + path + ": built without parquet support");
+#endif
+}
+
+template <typename T>
+static bool Missing(T v) {
+  return !(v > 0);
+}
+
+// forward fill non-positive and nan values down each column, the columns
+// are processed in blocks so that each row is read one cache line at a time
+template <typename T>
+static void Ffill(Array& arr) {
+  auto data = arr.data<T>();
+  auto nc = arr.num_columns;
+#pragma omp parallel for
+  for (auto j0 = 0; j0 < nc; j0 += kBlock) {
+    auto j1 = std::min(nc, j0 + kBlock);
+    T last[kBlock];
+    bool has[kBlock] = {};
+    for (auto i = 0; i < arr.num_rows; ++i) {
+      auto row = data + size_t(i) * nc;
+      for (auto j = j0; j < j1; ++j) {
+        if (!Missing(row[j])) {
+          last[j - j0] = row[j];
+          has[j - j0] = true;
+        } else if (has[j - j0]) {
+          row[j] = last[j - j0];
+        }
+      }
+    }
+  }
+}
+
+// b[n - 1] = 1, b[i] = b[i + 1] * a[i + 1] with non-positive and nan split
+// ratios taken as 1; adjusted_px = px / b, adjusted_vol = vol * b
+static void BackwardAdj(Array& arr) {
+  auto data = arr.data<double>();
+  auto nc = arr.num_columns;
+  auto nr = arr.num_rows;
+  if (nr == 0) return;
+#pragma omp parallel for
+  for (auto j0 = 0; j0 < nc; j0 += kBlock) {
+    auto j1 = std::min(nc, j0 + kBlock);
+    double next[kBlock];
+    for (auto j = j0; j < j1; ++j) next[j - j0] = 1;
+    auto last = data + size_t(nr - 1) * nc;
+    for (auto j = j0; j < j1; ++j) {
+      auto a = last[j];
+      last[j] = 1;
+      next[j - j0] = Missing(a) ? 1 : a;
+    }
+    for (auto i = nr - 2; i >= 0; --i) {
+      auto row = data + size_t(i) * nc;
+      auto below = row + nc;
+      for (auto j = j0; j < j1; ++j) {
+        auto a = row[j];
+        row[j] = below[j] * next[j - j0];
+        next[j - j0] = Missing(a) ? 1 : a;
+      }
+    }
+  }
+}
+
+// tiled transpose, T is a type of item_size bytes
+template <typename T>
+static void Transpose(Array& arr) {
+  static const int kTile = 32;
+  auto nr = arr.num_rows;
+  auto nc = arr.num_columns;
+  std::vector<char> bytes(arr.bytes.size());
+  auto in = arr.data<T>();
+  auto out = reinterpret_cast<T*>(bytes.data());
+#pragma omp parallel for collapse(2)
+  for (auto i0 = 0; i0 < nr; i0 += kTile) {
+    for (auto j0 = 0; j0 < nc; j0 += kTile) {
+      auto i1 = std::min(nr, i0 + kTile);
+      auto j1 = std::min(nc, j0 + kTile);
+      for (auto i = i0; i < i1; ++i) {
+        for (auto j = j0; j < j1; ++j) {
+          out[size_t(j) * nr + i] = in[size_t(i) * nc + j];
+        }
+      }
+    }
+  }
+  arr.bytes.swap(bytes);
+  std::swap(arr.num_rows, arr.num_columns);
+}
+
+template <int kSize>
+struct Item {
+  char c[kSize];
+};
+
+static void TransposeAny(Array& arr) {
+  if (arr.item_size == 8) return Transpose<int64_t>(arr);
+  // fixed-length strings of the symbol file
+  switch (arr.item_size) {
+    case 1: return Transpose<Item<1>>(arr);
+    case 2: return Transpose<Item<2>>(arr);
+    case 4: return Transpose<Item<4>>(arr);
+    case 16: return Transpose<Item<16>>(arr);
+    case 32: return Transpose<Item<32>>(arr);
+  }
+  // pad to a supported size
+  auto size = arr.item_size <= 16 ? 16 : arr.item_size <= 32 ? 32 : 0;
+  Check(size, "item size " + std::to_string(arr.item_size) + " too large");
+  std::vector<char> bytes(arr.bytes.size() / arr.item_size * size);
+  for (auto k = 0u; k < arr.bytes.size() / arr.item_size; ++k) {
+    memcpy(&bytes[k * size], &arr.bytes[k * arr.item_size], arr.item_size);
+  }
+  arr.bytes.swap(bytes);
+  arr.item_size = size;
+  TransposeAny(arr);
+}
+
+// apply the chained actions on path in one read/write pass
+static void Process(const std::string& path,
+                    const std::vector<std::string>& actions) {
+  auto arr = Read(path);
+  auto out_path = fs::path(path);
+  for (auto& action : actions) {
+    auto numeric = arr.type != Array::kString;
+    auto is_double = arr.type == Array::kDouble;
+    if (action == "ffill") {
+      Check(numeric, "ffill: " + path + " is not numeric");
+      if (is_double) {
+        Ffill<double>(arr);
+      } else {
+        Ffill<int64_t>(arr);
+      }
+    } else if (action == "nan2zero") {
+      if (!is_double) continue;
+      auto data = arr.data<double>();
+      auto n = arr.bytes.size() / sizeof(double);
+#pragma omp parallel for
+      for (auto k = 0ul; k < n; ++k) {
+        if (std::isnan(data[k])) data[k] = 0;
+      }
+    } else if (action == "zero2nan") {
+      Check(is_double, "zero2nan: " + path + " is not float");
+      auto data = arr.data<double>();
+      auto n = arr.bytes.size() / sizeof(double);
+#pragma omp parallel for
+      for (auto k = 0ul; k < n; ++k) {
+        if (data[k] == 0) data[k] = std::nan("");
+      }
+    } else if (action == "backward_adj") {
+      Check(is_double, "backward_adj: " + path + " is not float");
+      BackwardAdj(arr);
+    } else if (action == "transpose") {
+      TransposeAny(arr);
+      auto stem = out_path.stem().string() + "_t";
+      out_path = out_path.parent_path() / (stem + out_path.extension().string());
+    } else if (action == "par2h5") {
+      out_path.replace_extension(".h5");
+    } else if (action == "toarrow") {
+      out_path.replace_extension(".arrow");
+    }
+  }
+  Write(out_path.string(), arr);
+  std::cout << path << " -> " << out_path.string() << std::endl;
+}
+
+// (di, ii) pairs breaking a rule, printed as counts plus the first few
+struct Violations {
+  std::vector<std::vector<int>> items;
+  void Print(const std::string& title, const Array& arr) const {
+    if (items.empty()) return;
+    std::vector<bool> rows(arr.num_rows), columns(arr.num_columns);
+    for (auto& item : items) {
+      rows[item[0]] = true;
+      columns[item[1]] = true;
+    }
+    std::cout << title << "\n"
+              << items.size() << ", "
+              << std::count(rows.begin(), rows.end(), true) << " / "
+              << arr.num_rows << ", "
+              << std::count(columns.begin(), columns.end(), true) << " / "
+              << arr.num_columns << "\n";
+    for (auto k = 0u; k < items.size() && k < 20; ++k) {
+      for (auto v : items[k]) std::cout << v << " ";
+      std::cout << "\n";
+    }
+    if (items.size() > 20) std::cout << "...\n";
+    std::cout << std::endl;
+  }
+};
+
+static void Validate(const std::string& dir) {
+  auto close = ReadH5((fs::path(dir) / "close.h5").string());
+  Check(close.type == Array::kDouble, "close.h5 is not float");
+  auto nc = close.num_columns;
+  auto px = close.data<double>();
+  Violations unfilled, jumps;
+  auto nthreads = omp_get_max_threads();
+  std::vector<Violations> unfilled_t(nthreads), jumps_t(nthreads);
+#pragma omp parallel for
+  for (auto j0 = 0; j0 < nc; j0 += kBlock) {
+    auto t = omp_get_thread_num();
+    auto j1 = std::min(nc, j0 + kBlock);
+    double last[kBlock] = {};
+    for (auto i = 0; i < close.num_rows; ++i) {
+      auto row = px + size_t(i) * nc;
+      for (auto j = j0; j < j1; ++j) {
+        auto v = row[j];
+        auto& px0 = last[j - j0];
+        if (Missing(v)) {
+          if (px0 > 0) unfilled_t[t].items.push_back({i, j});
+          continue;
+        }
+        if (px0 > 0) {
+          auto x = v / px0;
+          if (x > 10 || x < 0.1)
+            jumps_t[t].items.push_back({i, j, int(100 * x)});
+        }
+        px0 = v;
+      }
+    }
+  }
+  for (auto t = 0; t < nthreads; ++t) {
+    auto& a = unfilled_t[t].items;
+    auto& b = jumps_t[t].items;
+    unfilled.items.insert(unfilled.items.end(), a.begin(), a.end());
+    jumps.items.insert(jumps.items.end(), b.begin(), b.end());
+  }
+  std::sort(unfilled.items.begin(), unfilled.items.end());
+  std::sort(jumps.items.begin(), jumps.items.end());
+  unfilled.Print("close.h5 is not forward filled", close);
+  jumps.Print("big price change % in close.h5", close);
+
+  for (auto name : {"sector", "industry", "industrygroup", "subindustry"}) {
+    auto path = fs::path(dir) / (std::string(name) + ".h5");
+    if (!fs::exists(path)) continue;
+    auto arr = ReadH5(path.string());
+    Check(arr.type != Array::kString, path.string() + " is not numeric");
+    Violations invalid;
+    for (auto i = 0; i < arr.num_rows; ++i) {
+      for (auto j = 0; j < arr.num_columns; ++j) {
+        auto k = size_t(i) * arr.num_columns + j;
+        auto bad = arr.type == Array::kDouble ? Missing(arr.data<double>()[k])
+                                              : arr.data<int64_t>()[k] <= 0;
+        if (bad) invalid.items.push_back({i, j});
+      }
+    }
+    invalid.Print(path.filename().string() + " has invalid value", arr);
+  }
+}
+
+}  // namespace openalpha
+
+int main(int argc, char* argv[]) {
+  static const std::vector<std::string> kActions = {
+      "ffill",    "validate", "transpose",    "nan2zero",
+      "zero2nan", "par2h5",   "backward_adj", "toarrow",
+  };
+  std::string action;
+  std::vector<std::string> paths;
+  int num_threads = 0;
+  bpo::options_description config("Usage: openalpha-data -a action[,...] "
+                                  "file ...\nActions: " +
+                                  boost::join(kActions, ", ") + "\nOptions");
+  config.add_options()("help,h", "produce help message")(
+      "action,a", bpo::value<std::string>(&action),
+      "comma separated actions applied in order in one pass per file")(
+      "threads,j", bpo::value<int>(&num_threads)->default_value(0),
+      "number of threads, 0 for all cores")(
+      "path", bpo::value<std::vector<std::string>>(&paths), "input files");
+  bpo::positional_options_description positional;
+  positional.add("path", -1);
+  try {
+    bpo::variables_map vm;
+    bpo::store(bpo::command_line_parser(argc, argv)
+                   .options(config)
+                   .positional(positional)
+                   .run(),
+               vm);
+    bpo::notify(vm);
+    if (vm.count("help") || action.empty() || paths.empty()) {
+      std::cerr << config << std::endl;
+      return 1;
+    }
+  } catch (bpo::error& e) {
+    std::cerr << "Bad Options: " << e.what() << std::endl;
+    return 1;
+  }
+
+  std::vector<std::string> actions;
+  boost::split(actions, action, boost::is_any_of(","));
+  for (auto& a : actions) {
+    if (std::find(kActions.begin(), kActions.end(), a) == kActions.end()) {
+      std::cerr << "unknown action '" << a << "'" << std::endl;
+      return 1;
+    }
+    if (a == "validate" && actions.size() > 1) {
+      std::cerr << "validate can't be chained with other actions"
+                << std::endl;
+      return 1;
+    }
+  }
+  if (num_threads > 0) omp_set_num_threads(num_threads);
+
+  try {
+    for (auto& path : paths) {
+      if (actions[0] == "validate") {
+        openalpha::Validate(path);
+      } else {
+        openalpha::Process(path, actions);
+      }
+    }
+  } catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
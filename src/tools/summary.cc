@@ -0,0 +1,384 @@
+// openalpha-summary: the metrics of scripts/simsummary.py for all alphas of
+// a store in one csv table, the daily files being read in parallel, e.g.
+//   openalpha-summary store > summary.csv
+//   openalpha-summary -p yearly -s fitness -n 20 store/Sample*
+
+#include <omp.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace bpo = boost::program_options;
+namespace fs = boost::filesystem;
+
+namespace openalpha {
+
+// numeric columns of the output, after alpha and period
+static const std::vector<std::string> kMetrics = {
+    "date_frm",  "date_to",     "days",       "pnl",        "ret",
+    "ir",        "sharpe",      "fitness",    "tvr",        "ret_tvr",
+    "long",      "short",       "trade",      "nlong",      "nshort",
+    "ntrade",    "perwin",      "up_days",    "down_days",  "up_weeks",
+    "down_weeks", "up_months",  "down_months", "dd",        "dd_start",
+    "dd_end",    "min_ret",     "min_ret_day", "max_ret",   "max_ret_day",
+    "cost",      "net_pnl",
+};
+
+// columns of daily.csv, cost and net_pnl are missing in old stores
+struct Daily {
+  std::vector<int> date;
+  std::vector<double> pnl, ret, tvr, long_pos, short_pos, sh_trd, nlong,
+      nshort, ntrade, cost, net_pnl;
+};
+
+struct Row {
+  std::string alpha;
+  std::string period;
+  std::vector<double> values;
+};
+
+static void Check(bool ok, const std::string& msg) {
+  if (!ok) throw std::runtime_error(msg);
+}
+
+static Daily ReadDaily(const fs::path& path) {
+  std::ifstream is(path.string(), std::ios::binary);
+  Check(!!is, "can't open " + path.string());
+  std::stringstream ss;
+  ss << is.rdbuf();
+  auto text = ss.str();
+  auto eol = text.find('\n');
+  Check(eol != std::string::npos, path.string() + " is empty");
+  std::vector<std::string> header;
+  auto head = text.substr(0, eol);
+  boost::trim_right_if(head, boost::is_any_of("\r"));
+  boost::split(header, head, boost::is_any_of(","));
+  Daily out;
+  std::map<std::string, std::vector<double>*> columns = {
+      {"pnl", &out.pnl},         {"ret", &out.ret},
+      {"tvr", &out.tvr},         {"long", &out.long_pos},
+      {"short", &out.short_pos}, {"sh_trd", &out.sh_trd},
+      {"nlong", &out.nlong},     {"nshort", &out.nshort},
+      {"ntrade", &out.ntrade},   {"cost", &out.cost},
+      {"net_pnl", &out.net_pnl},
+  };
+  Check(header[0] == "date", path.string() + " has no date column");
+  std::vector<std::vector<double>*> targets;
+  for (auto& name : header) {
+    auto it = columns.find(name);
+    targets.push_back(it == columns.end() ? nullptr : it->second);
+  }
+  for (auto& name : {"pnl", "ret", "tvr"}) {
+    Check(std::count(header.begin(), header.end(), name),
+          path.string() + " has no " + name + " column");
+  }
+  // strtod stops at the delimiters, so the text is parsed in place
+  auto p = text.c_str() + eol + 1;
+  auto end = text.c_str() + text.size();
+  while (p < end) {
+    if (*p == '\n' || *p == '\r') {
+      ++p;
+      continue;
+    }
+    char* next;
+    out.date.push_back(std::strtol(p, &next, 10));
+    p = next;
+    for (auto j = 1u; j < header.size() && *p == ','; ++j) {
+      auto v = std::strtod(p + 1, &next);
+      if (targets[j]) targets[j]->push_back(next == p + 1 ? 0 : v);
+      p = next;
+    }
+    while (p < end && *p != '\n') ++p;
+    for (auto target : targets) {
+      if (target) target->resize(out.date.size());
+    }
+  }
+  if (out.cost.empty()) out.cost.assign(out.date.size(), 0);
+  if (out.net_pnl.empty()) out.net_pnl = out.pnl;
+  return out;
+}
+
+// days since 1970-01-01 of yyyymmdd
+static int DayNumber(int date) {
+  int y = date / 10000;
+  unsigned m = date / 100 % 100;
+  unsigned d = date % 100;
+  y -= m <= 2;
+  int era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = y - era * 400;
+  unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + int(doe) - 719468;
+}
+
+// number of positive and negative sums of pnl over the groups of
+// consecutive days with the same key
+template <typename Key>
+static std::pair<int, int> UpDown(const Daily& daily, int i0, int i1,
+                                  Key key) {
+  std::pair<int, int> out{0, 0};
+  auto sum = 0.;
+  for (auto i = i0; i < i1; ++i) {
+    sum += daily.pnl[i];
+    if (i + 1 == i1 || key(daily.date[i + 1]) != key(daily.date[i])) {
+      if (sum > 0) ++out.first;
+      if (sum < 0) ++out.second;
+      sum = 0;
+    }
+  }
+  return out;
+}
+
+// like PerfSeries::Window, with the drawdown running from the first date as
+// in simsummary.py
+static std::vector<double> Summarize(const Daily& daily, int i0, int i1,
+                                     const std::vector<double>& dd,
+                                     const std::vector<int>& dd_start) {
+  std::vector<double> out(kMetrics.size(), 0);
+  auto d = i1 - i0;
+  auto sum = [&](const std::vector<double>& v) {
+    auto s = 0.;
+    for (auto i = i0; i < i1; ++i) s += v[i];
+    return s;
+  };
+  auto ret_sum = 0., ret_sum2 = 0.;
+  auto up_days = 0, down_days = 0;
+  auto min_ret = 0, max_ret = 0;
+  auto min_dd = 0;
+  for (auto i = i0; i < i1; ++i) {
+    auto ret = daily.ret[i];
+    ret_sum += ret;
+    ret_sum2 += ret * ret;
+    up_days += ret > 0;
+    down_days += ret < 0;
+    if (ret < daily.ret[i0 + min_ret]) min_ret = i - i0;
+    if (ret > daily.ret[i0 + max_ret]) max_ret = i - i0;
+    if (dd[i] < dd[i0 + min_dd]) min_dd = i - i0;
+  }
+  auto avg = ret_sum / d;
+  auto stddev = 0.;
+  if (d > 1) {
+    stddev = std::sqrt(
+        std::max(0., 1. / (d - 1) * (ret_sum2 - ret_sum * ret_sum / d)));
+  }
+  auto ir = stddev > 0 ? avg / stddev : 0.;
+  auto tvr = sum(daily.tvr) / d;
+  auto weeks = UpDown(daily, i0, i1,
+                      [](int date) { return (DayNumber(date) + 3) / 7; });
+  auto months = UpDown(daily, i0, i1, [](int date) { return date / 100; });
+  std::map<std::string, double> values = {
+      {"date_frm", daily.date[i0]},
+      {"date_to", daily.date[i1 - 1]},
+      {"days", d},
+      {"pnl", sum(daily.pnl)},
+      {"ret", avg},
+      {"ir", ir},
+      {"sharpe", ir * std::sqrt(252)},
+      {"fitness",
+       tvr > 0 ? ir * std::sqrt(252) * std::sqrt(std::abs(avg * 252) / tvr)
+               : 0},
+      {"tvr", tvr},
+      {"ret_tvr", tvr > 0 ? avg / tvr : 0},
+      {"long", sum(daily.long_pos) / d},
+      {"short", sum(daily.short_pos) / d},
+      {"trade", sum(daily.sh_trd) / d},
+      {"nlong", sum(daily.nlong) / d},
+      {"nshort", sum(daily.nshort) / d},
+      {"ntrade", sum(daily.ntrade) / d},
+      {"perwin", double(up_days) / d},
+      {"up_days", up_days},
+      {"down_days", down_days},
+      {"up_weeks", weeks.first},
+      {"down_weeks", weeks.second},
+      {"up_months", months.first},
+      {"down_months", months.second},
+      {"dd", dd[i0 + min_dd]},
+      {"dd_start", dd[i0 + min_dd] < 0 ? dd_start[i0 + min_dd] : 0},
+      {"dd_end", dd[i0 + min_dd] < 0 ? daily.date[i0 + min_dd] : 0},
+      {"min_ret", daily.ret[i0 + min_ret]},
+      {"min_ret_day", daily.date[i0 + min_ret]},
+      {"max_ret", daily.ret[i0 + max_ret]},
+      {"max_ret_day", daily.date[i0 + max_ret]},
+      {"cost", sum(daily.cost)},
+      {"net_pnl", sum(daily.net_pnl)},
+  };
+  for (auto j = 0u; j < kMetrics.size(); ++j) out[j] = values[kMetrics[j]];
+  return out;
+}
+
+// the whole range, then each year or month if period is given
+static std::vector<Row> Summarize(const std::string& alpha,
+                                  const Daily& daily,
+                                  const std::string& period) {
+  std::vector<Row> out;
+  int n = daily.date.size();
+  if (!n) return out;
+  std::vector<double> dd(n);
+  std::vector<int> dd_start(n);
+  auto dd_sum = 0.;
+  auto start = daily.date[0];
+  for (auto i = 0; i < n; ++i) {
+    if (dd_sum >= 0) start = daily.date[i];
+    dd_sum = std::min(0., dd_sum + daily.pnl[i]);
+    dd[i] = dd_sum;
+    dd_start[i] = start;
+  }
+  out.push_back({alpha, "all", Summarize(daily, 0, n, dd, dd_start)});
+  if (period == "all") return out;
+  auto divisor = period == "yearly" ? 10000 : 100;
+  for (auto i0 = 0; i0 < n;) {
+    auto key = daily.date[i0] / divisor;
+    auto i1 = i0 + 1;
+    while (i1 < n && daily.date[i1] / divisor == key) ++i1;
+    out.push_back(
+        {alpha, std::to_string(key), Summarize(daily, i0, i1, dd, dd_start)});
+    i0 = i1;
+  }
+  return out;
+}
+
+// daily.csv of an alpha directory, or of each alpha of a store directory
+static std::vector<fs::path> FindDaily(const std::vector<std::string>& paths) {
+  std::vector<fs::path> out;
+  for (auto& path : paths) {
+    if (!fs::is_directory(path)) {
+      out.push_back(path);
+    } else if (fs::exists(fs::path(path) / "daily.csv")) {
+      out.push_back(fs::path(path) / "daily.csv");
+    } else {
+      for (auto& entry : fs::directory_iterator(path)) {
+        auto daily = entry.path() / "daily.csv";
+        if (fs::exists(daily)) out.push_back(daily);
+      }
+    }
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+}  // namespace openalpha
+
+int main(int argc, char* argv[]) {
+  std::string period;
+  std::string sort;
+  std::string output;
+  std::vector<std::string> paths;
+  int num_threads = 0;
+  int top = 0;
+  bool ascending = false;
+  bpo::options_description config(
+      "Usage: openalpha-summary [options] [store|alpha_dir|daily.csv ...]\n"
+      "Metrics: " +
+      boost::join(openalpha::kMetrics, ", ") + "\nOptions");
+  config.add_options()("help,h", "produce help message")(
+      "period,p", bpo::value<std::string>(&period)->default_value("all"),
+      "all, yearly or monthly, a row per alpha and period besides 'all'")(
+      "sort,s", bpo::value<std::string>(&sort)->default_value("ir"),
+      "metric to sort by, descending")(
+      "ascending,a", bpo::bool_switch(&ascending), "sort ascending")(
+      "top,n", bpo::value<int>(&top)->default_value(0),
+      "first n rows only, 0 for all")(
+      "output,o", bpo::value<std::string>(&output),
+      "output csv file, stdout by default")(
+      "threads,j", bpo::value<int>(&num_threads)->default_value(0),
+      "number of threads, 0 for all cores")(
+      "path", bpo::value<std::vector<std::string>>(&paths),
+      "store (default ./store), alpha directories or daily.csv files");
+  bpo::positional_options_description positional;
+  positional.add("path", -1);
+  try {
+    bpo::variables_map vm;
+    bpo::store(bpo::command_line_parser(argc, argv)
+                   .options(config)
+                   .positional(positional)
+                   .run(),
+               vm);
+    bpo::notify(vm);
+    if (vm.count("help")) {
+      std::cerr << config << std::endl;
+      return 1;
+    }
+  } catch (bpo::error& e) {
+    std::cerr << "Bad Options: " << e.what() << std::endl;
+    return 1;
+  }
+  if (period != "all" && period != "yearly" && period != "monthly") {
+    std::cerr << "unknown period '" << period << "'" << std::endl;
+    return 1;
+  }
+  auto sort_it =
+      std::find(openalpha::kMetrics.begin(), openalpha::kMetrics.end(), sort);
+  if (sort_it == openalpha::kMetrics.end()) {
+    std::cerr << "unknown metric '" << sort << "'" << std::endl;
+    return 1;
+  }
+  auto sort_index = sort_it - openalpha::kMetrics.begin();
+  if (paths.empty()) paths.push_back("store");
+  if (num_threads > 0) omp_set_num_threads(num_threads);
+
+  std::vector<fs::path> files;
+  try {
+    files = openalpha::FindDaily(paths);
+  } catch (fs::filesystem_error& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  std::vector<std::vector<openalpha::Row>> rows(files.size());
+  auto num_errors = 0;
+#pragma omp parallel for schedule(dynamic)
+  for (auto i = 0; i < int(files.size()); ++i) {
+    try {
+      auto daily = openalpha::ReadDaily(files[i]);
+      auto alpha = files[i].parent_path().filename().string();
+      rows[i] = openalpha::Summarize(alpha, daily, period);
+    } catch (std::exception& e) {
+#pragma omp critical
+      {
+        std::cerr << e.what() << std::endl;
+        ++num_errors;
+      }
+    }
+  }
+  std::vector<openalpha::Row> table;
+  for (auto& part : rows) {
+    for (auto& row : part) table.push_back(std::move(row));
+  }
+  std::stable_sort(table.begin(), table.end(),
+                   [sort_index, ascending](const openalpha::Row& a,
+                                           const openalpha::Row& b) {
+                     auto x = a.values[sort_index];
+                     auto y = b.values[sort_index];
+                     return ascending ? x < y : x > y;
+                   });
+  if (top > 0 && int(table.size()) > top) table.resize(top);
+
+  std::ofstream file;
+  if (output.size()) {
+    file.open(output);
+    if (!file) {
+      std::cerr << "can't open " << output << std::endl;
+      return 1;
+    }
+  }
+  auto& os = output.size() ? file : std::cout;
+  os << "alpha,period," << boost::join(openalpha::kMetrics, ",") << '\n'
+     << std::setprecision(15);
+  for (auto& row : table) {
+    os << row.alpha << ',' << row.period;
+    for (auto v : row.values) os << ',' << v;
+    os << '\n';
+  }
+  std::cerr << files.size() - num_errors << " alphas summarized" << std::endl;
+  return num_errors ? 1 : 0;
+}